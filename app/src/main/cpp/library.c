@@ -5,11 +5,24 @@
 #include <libavutil/avutil.h>
 #include <libavutil/mathematics.h>
 #include <libavutil/time.h>
+#include <pthread.h>
+#include "media_probe.h"
+#include "merge.h"
+#include "merge_queue.h"
 
 #define LOG_TAG "FFmpegMerge"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
+static JavaVM *javaVm = NULL;
+static jclass toolsClass = NULL;
+static jmethodID onMergeProgressId = NULL;
+static jmethodID onMergeFinishId = NULL;
+static MergeQueue *mergeQueue = NULL;
+/* Kept here so a budget set before the queue exists applies once it starts */
+static int64_t mergeIoBudget = 0;
+static pthread_mutex_t mergeQueueLock = PTHREAD_MUTEX_INITIALIZER;
+
 /* Helper function to throw Java exception */
 void throwJavaException(JNIEnv *env, const char *message) {
     jclass exceptionClass = (*env)->FindClass(env, "java/lang/RuntimeException");
@@ -18,274 +31,170 @@ void throwJavaException(JNIEnv *env, const char *message) {
     }
 }
 
-int isVideoFile(AVFormatContext *ctx) {
-    unsigned int i;
-    for (i = 0; i < ctx->nb_streams; i++) {
-        if (ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            return 1;
-        }
-    }
-    return 0;
-}
-
 jint merge_av(JNIEnv *env, jobject thiz, jstring file1, jstring file2, jstring out) {
     const char *file1Path = (*env)->GetStringUTFChars(env, file1, NULL);
     const char *file2Path = (*env)->GetStringUTFChars(env, file2, NULL);
     const char *outputPath = (*env)->GetStringUTFChars(env, out, NULL);
 
-    LOGI("Starting audio-video merge: %s + %s -> %s", file1Path, file2Path, outputPath);
-
-    AVFormatContext *ctx1 = NULL;
-    AVFormatContext *ctx2 = NULL;
-    AVFormatContext *outCtx = NULL;
-    AVStream *videoStream = NULL;
-    AVStream *audioStream = NULL;
-    AVStream *inAudioStream = NULL;
-    int videoStreamIndex = -1;
-    int audioStreamIndex = -1;
-    int64_t videoDuration = 0;
-    AVPacket *packet = NULL;
-    int64_t videoStartPts = AV_NOPTS_VALUE;
-    int64_t audioStartPts = AV_NOPTS_VALUE;
-    jint ret = 0;
-
-    /* Open first file */
-    int ret_code = avformat_open_input(&ctx1, file1Path, NULL, NULL);
-    if (ret_code < 0) {
-        char errbuf[AV_ERROR_MAX_STRING_SIZE];
-        av_strerror(ret_code, errbuf, AV_ERROR_MAX_STRING_SIZE);
-        LOGE("Failed to open first input file: %s, Error: %s", file1Path, errbuf);
-        
-        /* Try to get file format information */
-        AVProbeData probe_data = {0};
-        probe_data.filename = file1Path;
-        probe_data.buf = NULL;
-        probe_data.buf_size = 0;
-        
-        const AVInputFormat *fmt = av_probe_input_format(&probe_data, 1);
-        if (fmt) {
-            LOGE("Detected format: %s, Long name: %s", fmt->name, fmt->long_name);
-        } else {
-            LOGE("Could not detect file format");
-        }
-        
-        throwJavaException(env, "Failed to open first input file");
-        ret = -1;
-        goto end;
-    }
-    if (avformat_find_stream_info(ctx1, NULL) < 0) {
-        LOGE("Failed to find stream info for first file: %s", file1Path);
-        throwJavaException(env, "Failed to find stream info for first file");
-        ret = -2;
-        goto end;
-    }
-
-    /* Open second file */
-    if (avformat_open_input(&ctx2, file2Path, NULL, NULL) < 0) {
-        LOGE("Failed to open second input file: %s", file2Path);
-        throwJavaException(env, "Failed to open second input file");
-        ret = -3;
-        goto end;
-    }
-    if (avformat_find_stream_info(ctx2, NULL) < 0) {
-        LOGE("Failed to find stream info for second file: %s", file2Path);
-        throwJavaException(env, "Failed to find stream info for second file");
-        ret = -4;
-        goto end;
-    }
-
-    /* Determine which is video file and which is audio file */
-    AVFormatContext *videoCtx, *audioCtx;
-    const char *videoPath, *audioPath;
-    
-    if (isVideoFile(ctx1)) {
-        videoCtx = ctx1;
-        audioCtx = ctx2;
-        videoPath = file1Path;
-        audioPath = file2Path;
-    } else {
-        videoCtx = ctx2;
-        audioCtx = ctx1;
-        videoPath = file2Path;
-        audioPath = file1Path;
+    const char *errMsg = NULL;
+    jint ret = merge_av_files(file1Path, file2Path, outputPath, NULL, &errMsg);
+    if (ret != 0 && errMsg != NULL) {
+        throwJavaException(env, errMsg);
     }
 
-    /* Allocate packet */
-    packet = av_packet_alloc();
-    if (!packet) {
-        LOGE("Failed to allocate AVPacket memory");
-        throwJavaException(env, "Failed to allocate memory for packet");
-        ret = -5;
-        goto end;
-    }
+    (*env)->ReleaseStringUTFChars(env, file1, file1Path);
+    (*env)->ReleaseStringUTFChars(env, file2, file2Path);
+    (*env)->ReleaseStringUTFChars(env, out, outputPath);
+    return ret;
+}
 
-    /* Create output context */
-    avformat_alloc_output_context2(&outCtx, NULL, NULL, outputPath);
-    if (!outCtx) {
-        LOGE("Failed to create output context: %s", outputPath);
-        throwJavaException(env, "Failed to create output context");
-        ret = -6;
-        goto end;
+/* Merge queue callbacks, invoked on the queue's worker threads */
+static int mergeThreadStart(void) {
+    JNIEnv *env;
+    if ((*javaVm)->AttachCurrentThread(javaVm, &env, NULL) != JNI_OK) {
+        LOGE("Failed to attach merge worker to JVM");
+        return -1;
     }
+    return 0;
+}
 
-    /* Find video and audio stream indices */
-    for (int i = 0; i < videoCtx->nb_streams; i++) {
-        if (videoCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            videoStreamIndex = i;
-            videoDuration = videoCtx->streams[i]->duration;
-            break;
-        }
-    }
+static void mergeThreadStop(void) {
+    (*javaVm)->DetachCurrentThread(javaVm);
+}
 
-    for (int i = 0; i < audioCtx->nb_streams; i++) {
-        if (audioCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-            audioStreamIndex = i;
-            break;
-        }
+static JNIEnv *currentEnv(void) {
+    JNIEnv *env = NULL;
+    if ((*javaVm)->GetEnv(javaVm, (void **) &env, JNI_VERSION_1_6) != JNI_OK) {
+        return NULL;
     }
+    return env;
+}
 
-    if (videoStreamIndex == -1 || audioStreamIndex == -1) {
-        LOGE("Video or audio stream not found - Video stream index: %d, Audio stream index: %d", videoStreamIndex, audioStreamIndex);
-        throwJavaException(env, "Required video or audio stream not found in input files");
-        ret = -7;
-        goto end;
+static void mergeProgress(merge_job_id_t id, float progress) {
+    JNIEnv *env = currentEnv();
+    if (env == NULL) return;
+    (*env)->CallStaticVoidMethod(env, toolsClass, onMergeProgressId, (jlong) id, (jfloat) progress);
+    if ((*env)->ExceptionCheck(env)) {
+        (*env)->ExceptionClear(env);
     }
+}
 
-    LOGI("Found video stream index: %d, audio stream index: %d", videoStreamIndex, audioStreamIndex);
-
-    /* Add video streams */
-    for (int i = 0; i < videoCtx->nb_streams; i++) {
-        AVStream *inStream = videoCtx->streams[i];
-        if (inStream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) {
-            AVStream *outStream = avformat_new_stream(outCtx, NULL);
-            if (!outStream) {
-                LOGE("Failed to create output video stream");
-                throwJavaException(env, "Failed to create output video stream");
-                ret = -8;
-                goto end;
-            }
-            if (avcodec_parameters_copy(outStream->codecpar, inStream->codecpar) < 0) {
-                LOGE("Failed to copy video stream parameters");
-                throwJavaException(env, "Failed to copy video stream parameters");
-                ret = -9;
-                goto end;
-            }
-            if (inStream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-                videoStream = outStream;
-                /* Copy timebase */
-                outStream->time_base = inStream->time_base;
-            }
-        }
+static void mergeFinish(merge_job_id_t id, int result, const char *errMsg) {
+    JNIEnv *env = currentEnv();
+    if (env == NULL) return;
+    jstring msg = errMsg ? (*env)->NewStringUTF(env, errMsg) : NULL;
+    (*env)->CallStaticVoidMethod(env, toolsClass, onMergeFinishId, (jlong) id, (jint) result, msg);
+    if ((*env)->ExceptionCheck(env)) {
+        (*env)->ExceptionClear(env);
     }
+    if (msg) (*env)->DeleteLocalRef(env, msg);
+}
 
-    /* Add audio stream */
-    inAudioStream = audioCtx->streams[audioStreamIndex];
-    audioStream = avformat_new_stream(outCtx, NULL);
-    if (!audioStream) {
-        LOGE("Failed to create output audio stream");
-        throwJavaException(env, "Failed to create output audio stream");
-        ret = -10;
-        goto end;
-    }
-    if (avcodec_parameters_copy(audioStream->codecpar, inAudioStream->codecpar) < 0) {
-        LOGE("Failed to copy audio stream parameters");
-        throwJavaException(env, "Failed to copy audio stream parameters");
-        ret = -11;
-        goto end;
-    }
-    audioStream->time_base = inAudioStream->time_base;
+static const MergeQueueCallbacks mergeCallbacks = {
+    .on_thread_start = mergeThreadStart,
+    .on_thread_stop = mergeThreadStop,
+    .on_progress = mergeProgress,
+    .on_finish = mergeFinish,
+};
 
-    /* Open output file */
-    if (!(outCtx->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&outCtx->pb, outputPath, AVIO_FLAG_WRITE) < 0) {
-            LOGE("Failed to open output file: %s", outputPath);
-            throwJavaException(env, "Failed to open output file for writing");
-            ret = -12;
-            goto end;
-        }
+/* Creates the queue on first use with the current I/O budget */
+static MergeQueue *obtainMergeQueue(jint workers) {
+    pthread_mutex_lock(&mergeQueueLock);
+    if (mergeQueue == NULL) {
+        mergeQueue = merge_queue_create(workers, mergeIoBudget, &mergeCallbacks);
     }
+    MergeQueue *queue = mergeQueue;
+    pthread_mutex_unlock(&mergeQueueLock);
+    return queue;
+}
 
-    /* Write file header */
-    if (avformat_write_header(outCtx, NULL) < 0) {
-        LOGE("Failed to write file header");
-        throwJavaException(env, "Failed to write output file header");
-        ret = -13;
-        goto end;
-    }
-    
-    /* Write video data first */
-    while (av_read_frame(videoCtx, packet) >= 0) {
-        if (packet->stream_index == videoStreamIndex) {
-            /* Record PTS of the first video frame */
-            if (videoStartPts == AV_NOPTS_VALUE) {
-                videoStartPts = packet->pts;
-            }
-            
-            /* Adjust PTS and DTS */
-            packet->pts -= videoStartPts;
-            if (packet->dts != AV_NOPTS_VALUE) {
-                packet->dts -= videoStartPts;
-            }
-            
-            packet->stream_index = videoStream->index;
-            av_write_frame(outCtx, packet);
-        }
-        av_packet_unref(packet);
+void set_merge_io_budget(JNIEnv *env, jobject thiz, jlong ioBytesPerSecond) {
+    pthread_mutex_lock(&mergeQueueLock);
+    mergeIoBudget = ioBytesPerSecond;
+    if (mergeQueue != NULL) {
+        merge_queue_set_io_budget(mergeQueue, ioBytesPerSecond);
     }
+    pthread_mutex_unlock(&mergeQueueLock);
+}
 
-    /* Write audio data */
-    while (av_read_frame(audioCtx, packet) >= 0) {
-        if (packet->stream_index == audioStreamIndex) {
-            /* Record PTS of the first audio frame */
-            if (audioStartPts == AV_NOPTS_VALUE) {
-                audioStartPts = packet->pts;
-            }
-            
-            /* Adjust audio PTS and DTS */
-            packet->pts -= audioStartPts;
-            if (packet->dts != AV_NOPTS_VALUE) {
-                packet->dts -= audioStartPts;
-            }
-            
-            /* Ensure audio duration doesn't exceed video duration */
-            if (packet->pts * av_q2d(audioStream->time_base) > 
-                videoDuration * av_q2d(videoCtx->streams[videoStreamIndex]->time_base)) {
-                break;
-            }
-            
-            packet->stream_index = audioStream->index;
-            av_write_frame(outCtx, packet);
-        }
-        av_packet_unref(packet);
+void init_merge_queue(JNIEnv *env, jobject thiz, jint workers, jlong ioBytesPerSecond) {
+    set_merge_io_budget(env, thiz, ioBytesPerSecond);
+    if (obtainMergeQueue(workers) == NULL) {
+        throwJavaException(env, "Failed to start merge queue");
     }
+}
 
-    /* Write file trailer */
-    if (av_write_trailer(outCtx) < 0) {
-        LOGE("Failed to write file trailer");
-        ret = -14;
-    } else if (ret == 0) {
-        LOGI("Audio-video merge completed successfully: %s", outputPath);
+jlong submit_merge(JNIEnv *env, jobject thiz, jstring file1, jstring file2, jstring out, jint priority) {
+    MergeQueue *queue = obtainMergeQueue(0);
+    if (queue == NULL) {
+        throwJavaException(env, "Failed to start merge queue");
+        return -1;
     }
+    const char *file1Path = (*env)->GetStringUTFChars(env, file1, NULL);
+    const char *file2Path = (*env)->GetStringUTFChars(env, file2, NULL);
+    const char *outputPath = (*env)->GetStringUTFChars(env, out, NULL);
 
-end:
-    if (ret != 0) {
-        LOGE("Audio-video merge failed with error code: %d", ret);
-    }
-    /* Cleanup resources */
-    if (packet) av_packet_free(&packet);
-    if (ctx1) avformat_close_input(&ctx1);
-    if (ctx2) avformat_close_input(&ctx2);
-    if (outCtx) {
-        if (!(outCtx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&outCtx->pb);
-        }
-        avformat_free_context(outCtx);
-    }
+    jlong id = merge_queue_submit(queue, file1Path, file2Path, outputPath, priority);
 
     (*env)->ReleaseStringUTFChars(env, file1, file1Path);
     (*env)->ReleaseStringUTFChars(env, file2, file2Path);
     (*env)->ReleaseStringUTFChars(env, out, outputPath);
-    return ret;
+    return id;
+}
+
+jboolean cancel_merge(JNIEnv *env, jobject thiz, jlong id) {
+    pthread_mutex_lock(&mergeQueueLock);
+    MergeQueue *queue = mergeQueue;
+    pthread_mutex_unlock(&mergeQueueLock);
+    if (queue == NULL) {
+        return JNI_FALSE;
+    }
+    return merge_queue_cancel(queue, id) ? JNI_TRUE : JNI_FALSE;
+}
+
+jobject probe_media(JNIEnv *env, jobject thiz, jstring path) {
+    const char *filePath = (*env)->GetStringUTFChars(env, path, NULL);
+    MediaInfo info;
+    int ret = media_probe(filePath, &info);
+    (*env)->ReleaseStringUTFChars(env, path, filePath);
+    if (ret < 0) {
+        return NULL;
+    }
+
+    jclass streamClass = (*env)->FindClass(env, "io/github/yearsyan/yaad/media/MediaStreamInfo");
+    jclass infoClass = (*env)->FindClass(env, "io/github/yearsyan/yaad/media/MediaInfo");
+    if (streamClass == NULL || infoClass == NULL) {
+        return NULL;
+    }
+    jmethodID createStream = (*env)->GetStaticMethodID(env, streamClass, "create",
+            "(ILjava/lang/String;Ljava/lang/String;IIIIJJ)Lio/github/yearsyan/yaad/media/MediaStreamInfo;");
+    jmethodID createInfo = (*env)->GetStaticMethodID(env, infoClass, "create",
+            "(Ljava/lang/String;JJ[Lio/github/yearsyan/yaad/media/MediaStreamInfo;)Lio/github/yearsyan/yaad/media/MediaInfo;");
+    if (createStream == NULL || createInfo == NULL) {
+        return NULL;
+    }
+
+    jobjectArray streams = (*env)->NewObjectArray(env, info.nb_streams, streamClass, NULL);
+    for (int i = 0; i < info.nb_streams; i++) {
+        const MediaStreamInfo *s = &info.streams[i];
+        const char *typeName = av_get_media_type_string(s->type);
+        jstring type = (*env)->NewStringUTF(env, typeName ? typeName : "unknown");
+        jstring codec = (*env)->NewStringUTF(env, avcodec_get_name(s->codec_id));
+        jobject stream = (*env)->CallStaticObjectMethod(env, streamClass, createStream,
+                s->index, type, codec, s->width, s->height, s->sample_rate, s->channels,
+                (jlong) s->bit_rate, (jlong) s->duration_us);
+        (*env)->SetObjectArrayElement(env, streams, i, stream);
+        (*env)->DeleteLocalRef(env, stream);
+        (*env)->DeleteLocalRef(env, codec);
+        (*env)->DeleteLocalRef(env, type);
+    }
+
+    jstring formatName = (*env)->NewStringUTF(env, info.format_name);
+    jobject result = (*env)->CallStaticObjectMethod(env, infoClass, createInfo, formatName,
+            (jlong) info.duration_us, (jlong) info.bit_rate, streams);
+    (*env)->DeleteLocalRef(env, formatName);
+    (*env)->DeleteLocalRef(env, streams);
+    return result;
 }
 
 jstring ffmpeg_configuration(JNIEnv *env, jobject thiz) {
@@ -295,11 +204,17 @@ jstring ffmpeg_configuration(JNIEnv *env, jobject thiz) {
 
 static JNINativeMethod methods[] = {
     {"mergeAV", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)I", (void*)merge_av},
-    {"configuration", "()Ljava/lang/String;", (void*)ffmpeg_configuration}
+    {"configuration", "()Ljava/lang/String;", (void*)ffmpeg_configuration},
+    {"initMergeQueue", "(IJ)V", (void*)init_merge_queue},
+    {"setMergeIoBudget", "(J)V", (void*)set_merge_io_budget},
+    {"submitMerge", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;I)J", (void*)submit_merge},
+    {"cancelMerge", "(J)Z", (void*)cancel_merge},
+    {"probe", "(Ljava/lang/String;)Lio/github/yearsyan/yaad/media/MediaInfo;", (void*)probe_media}
 };
 
 JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* reserved) {
     JNIEnv* env;
+    javaVm = vm;
     if ((*vm)->GetEnv(vm, (void**)&env, JNI_VERSION_1_6) != JNI_OK) {
         LOGE("Failed to get JNI environment");
         return JNI_ERR;
@@ -316,6 +231,14 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* reserved) {
         return JNI_ERR;
     }
 
+    onMergeProgressId = (*env)->GetStaticMethodID(env, clazz, "onMergeProgress", "(JF)V");
+    onMergeFinishId = (*env)->GetStaticMethodID(env, clazz, "onMergeFinish", "(JILjava/lang/String;)V");
+    if (onMergeProgressId == NULL || onMergeFinishId == NULL) {
+        LOGE("Failed to find merge callbacks");
+        return JNI_ERR;
+    }
+    toolsClass = (*env)->NewGlobalRef(env, clazz);
+
     LOGI("FFmpegTools JNI library loaded successfully");
     return JNI_VERSION_1_6;
 }
\ No newline at end of file
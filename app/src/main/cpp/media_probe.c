@@ -0,0 +1,251 @@
+#include "media_probe.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <android/log.h>
+#include <libavutil/avstring.h>
+#include <libavutil/dict.h>
+#include <libavutil/mathematics.h>
+
+#define LOG_TAG "FFmpegProbe"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+/* Far below the FFmpeg defaults (5 MB / 5 s), enough for the headers of downloaded media */
+#define PROBE_SIZE (512 * 1024)
+#define PROBE_ANALYZE_DURATION_US 1000000
+#define MEDIA_CACHE_CAPACITY 128
+
+typedef struct CacheEntry {
+    char *path;
+    int64_t size;
+    int64_t mtime_ns;
+    uint64_t last_used;
+    MediaInfo info;
+} CacheEntry;
+
+static CacheEntry cache[MEDIA_CACHE_CAPACITY];
+static uint64_t cacheClock = 0;
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int fileKey(const char *path, int64_t *size, int64_t *mtime_ns) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+    *size = st.st_size;
+    *mtime_ns = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return 0;
+}
+
+static int cacheLookup(const char *path, MediaInfo *info) {
+    int64_t size, mtime_ns;
+    if (fileKey(path, &size, &mtime_ns) != 0) {
+        return 0;
+    }
+    int found = 0;
+    pthread_mutex_lock(&cacheLock);
+    for (int i = 0; i < MEDIA_CACHE_CAPACITY; i++) {
+        CacheEntry *entry = &cache[i];
+        if (entry->path && strcmp(entry->path, path) == 0) {
+            if (entry->size == size && entry->mtime_ns == mtime_ns) {
+                entry->last_used = ++cacheClock;
+                *info = entry->info;
+                found = 1;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cacheLock);
+    return found;
+}
+
+static void cacheStore(const char *path, const MediaInfo *info) {
+    int64_t size, mtime_ns;
+    if (fileKey(path, &size, &mtime_ns) != 0) {
+        return;
+    }
+    pthread_mutex_lock(&cacheLock);
+    CacheEntry *slot = NULL;
+    for (int i = 0; i < MEDIA_CACHE_CAPACITY; i++) {
+        CacheEntry *entry = &cache[i];
+        if (entry->path && strcmp(entry->path, path) == 0) {
+            slot = entry;
+            break;
+        }
+        /* Prefer an empty slot, otherwise evict the least recently used one */
+        if (!slot || (slot->path && (!entry->path || entry->last_used < slot->last_used))) {
+            slot = entry;
+        }
+    }
+    if (!slot->path || strcmp(slot->path, path) != 0) {
+        char *copy = strdup(path);
+        if (!copy) {
+            pthread_mutex_unlock(&cacheLock);
+            return;
+        }
+        free(slot->path);
+        slot->path = copy;
+    }
+    slot->size = size;
+    slot->mtime_ns = mtime_ns;
+    slot->last_used = ++cacheClock;
+    slot->info = *info;
+    pthread_mutex_unlock(&cacheLock);
+}
+
+/* Whether the demuxer header already gave everything a remux needs */
+static int streamsComplete(AVFormatContext *ctx) {
+    if (ctx->nb_streams == 0) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < ctx->nb_streams; i++) {
+        AVCodecParameters *par = ctx->streams[i]->codecpar;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+            if (par->codec_id == AV_CODEC_ID_NONE || par->width <= 0 || par->height <= 0) {
+                return 0;
+            }
+        } else if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+            if (par->codec_id == AV_CODEC_ID_NONE || par->sample_rate <= 0 ||
+                par->ch_layout.nb_channels <= 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void describe(AVFormatContext *ctx, MediaInfo *info) {
+    memset(info, 0, sizeof(MediaInfo));
+    av_strlcpy(info->format_name, ctx->iformat->name, sizeof(info->format_name));
+    info->duration_us = ctx->duration != AV_NOPTS_VALUE ? ctx->duration : 0;
+    info->bit_rate = ctx->bit_rate;
+    info->video_index = -1;
+    info->audio_index = -1;
+
+    for (unsigned int i = 0; i < ctx->nb_streams; i++) {
+        AVStream *stream = ctx->streams[i];
+        AVCodecParameters *par = stream->codecpar;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO && info->video_index < 0) {
+            info->video_index = (int) i;
+        } else if (par->codec_type == AVMEDIA_TYPE_AUDIO && info->audio_index < 0) {
+            info->audio_index = (int) i;
+        }
+        if (info->nb_streams >= MEDIA_INFO_MAX_STREAMS) {
+            continue;
+        }
+        MediaStreamInfo *s = &info->streams[info->nb_streams++];
+        s->index = (int) i;
+        s->type = par->codec_type;
+        s->codec_id = par->codec_id;
+        s->width = par->width;
+        s->height = par->height;
+        s->sample_rate = par->sample_rate;
+        s->channels = par->ch_layout.nb_channels;
+        s->bit_rate = par->bit_rate;
+        s->duration_us = stream->duration != AV_NOPTS_VALUE
+                ? av_rescale_q(stream->duration, stream->time_base, AV_TIME_BASE_Q)
+                : 0;
+    }
+}
+
+/* Whether a cached description belongs to the streams this demuxer produced */
+static int cacheMatches(AVFormatContext *ctx, const MediaInfo *info) {
+    unsigned int described = ctx->nb_streams < MEDIA_INFO_MAX_STREAMS
+            ? ctx->nb_streams : MEDIA_INFO_MAX_STREAMS;
+    if (ctx->nb_streams == 0 || (unsigned int) info->nb_streams != described) {
+        return 0;
+    }
+    for (int i = 0; i < info->nb_streams; i++) {
+        const MediaStreamInfo *s = &info->streams[i];
+        if (s->index != i || ctx->streams[i]->codecpar->codec_type != s->type) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Restore the durations the header left out. Codec parameters are never
+ * taken from the cache: it can't hold extradata, pixel format or frame
+ * rate, so a remux must not depend on it for anything but timing.
+ */
+static void applyCachedDurations(AVFormatContext *ctx, const MediaInfo *info) {
+    for (int i = 0; i < info->nb_streams; i++) {
+        const MediaStreamInfo *s = &info->streams[i];
+        AVStream *stream = ctx->streams[i];
+        if ((stream->duration == AV_NOPTS_VALUE || stream->duration <= 0) && s->duration_us > 0) {
+            stream->duration = av_rescale_q(s->duration_us, AV_TIME_BASE_Q, stream->time_base);
+        }
+    }
+    if ((ctx->duration == AV_NOPTS_VALUE || ctx->duration <= 0) && info->duration_us > 0) {
+        ctx->duration = info->duration_us;
+    }
+}
+
+int media_open_input(AVFormatContext **ctx, const char *path, const AVIOInterruptCB *interrupt,
+                     MediaInfo *info, int *cached) {
+    const AVInputFormat *fmt = NULL;
+    *cached = cacheLookup(path, info);
+    if (*cached) {
+        /* iformat names may list aliases ("mov,mp4,..."), look up the first one */
+        char name[sizeof(info->format_name)];
+        av_strlcpy(name, info->format_name, sizeof(name));
+        char *comma = strchr(name, ',');
+        if (comma) *comma = '\0';
+        fmt = av_find_input_format(name);
+    }
+
+    *ctx = avformat_alloc_context();
+    if (!*ctx) {
+        return AVERROR(ENOMEM);
+    }
+    if (interrupt) {
+        (*ctx)->interrupt_callback = *interrupt;
+    }
+
+    AVDictionary *opts = NULL;
+    av_dict_set_int(&opts, "probesize", PROBE_SIZE, 0);
+    av_dict_set_int(&opts, "analyzeduration", PROBE_ANALYZE_DURATION_US, 0);
+    /* avformat_open_input frees the context on failure */
+    int ret = avformat_open_input(ctx, path, fmt, &opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
+int media_find_stream_info(AVFormatContext *ctx, const char *path, MediaInfo *info, int cached) {
+    int complete = streamsComplete(ctx);
+    if (cached && complete && cacheMatches(ctx, info)) {
+        applyCachedDurations(ctx, info);
+        return 0;
+    }
+    if (!complete) {
+        int ret = avformat_find_stream_info(ctx, NULL);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    describe(ctx, info);
+    cacheStore(path, info);
+    return 0;
+}
+
+int media_probe(const char *path, MediaInfo *info) {
+    if (cacheLookup(path, info)) {
+        return 0;
+    }
+    AVFormatContext *ctx = NULL;
+    int cached = 0;
+    int ret = media_open_input(&ctx, path, NULL, info, &cached);
+    if (ret < 0) {
+        LOGE("Failed to open %s for probing", path);
+        return ret;
+    }
+    ret = media_find_stream_info(ctx, path, info, cached);
+    if (ret < 0) {
+        LOGE("Failed to find stream info for %s", path);
+    }
+    avformat_close_input(&ctx);
+    return ret;
+}
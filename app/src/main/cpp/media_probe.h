@@ -0,0 +1,56 @@
+#ifndef YAAD_MEDIA_PROBE_H
+#define YAAD_MEDIA_PROBE_H
+
+#include <stdint.h>
+#include <libavformat/avformat.h>
+
+#define MEDIA_INFO_MAX_STREAMS 16
+
+typedef struct MediaStreamInfo {
+    int index;
+    enum AVMediaType type;
+    enum AVCodecID codec_id;
+    int width;
+    int height;
+    int sample_rate;
+    int channels;
+    int64_t bit_rate;
+    int64_t duration_us;
+} MediaStreamInfo;
+
+typedef struct MediaInfo {
+    char format_name[64];
+    int64_t duration_us;
+    int64_t bit_rate;
+    /* First video/audio stream, -1 if the file has none */
+    int video_index;
+    int audio_index;
+    /* Streams past MEDIA_INFO_MAX_STREAMS are not described */
+    int nb_streams;
+    MediaStreamInfo streams[MEDIA_INFO_MAX_STREAMS];
+} MediaInfo;
+
+/*
+ * Fill info for path, from the cache when the file's size and mtime are
+ * unchanged since the last probe. Returns 0 or a negative AVERROR.
+ */
+int media_probe(const char *path, MediaInfo *info);
+
+/*
+ * Open path with bounded probing. When the file is in the cache (same size
+ * and mtime) its demuxer is picked directly, the cached result is copied to
+ * info and *cached is set to 1; otherwise *cached is 0.
+ */
+int media_open_input(AVFormatContext **ctx, const char *path, const AVIOInterruptCB *interrupt,
+                     MediaInfo *info, int *cached);
+
+/*
+ * Complete the stream parameters of an opened input. The input is probed
+ * with avformat_find_stream_info only if the header is incomplete. When the
+ * header is complete and a cached info matches the demuxed streams, only
+ * its stream indices and durations are used; otherwise the streams are
+ * described in info and cached for path.
+ */
+int media_find_stream_info(AVFormatContext *ctx, const char *path, MediaInfo *info, int cached);
+
+#endif /* YAAD_MEDIA_PROBE_H */
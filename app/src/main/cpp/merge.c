@@ -0,0 +1,350 @@
+#include "merge.h"
+#include "media_probe.h"
+#include <stdio.h>
+#include <android/log.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+
+#define LOG_TAG "FFmpegMerge"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+/* Report progress only when it moved at least this much */
+#define PROGRESS_STEP 0.01f
+
+static int isCancelled(const MergeControl *ctl) {
+    return ctl && ctl->cancelled && atomic_load(ctl->cancelled);
+}
+
+static int interruptCallback(void *opaque) {
+    return isCancelled((const MergeControl *) opaque);
+}
+
+static void setError(const char **err_msg, const char *msg) {
+    if (err_msg) {
+        *err_msg = msg;
+    }
+}
+
+static void reportProgress(const MergeControl *ctl, float *lastProgress, float progress) {
+    if (!ctl || !ctl->on_progress) {
+        return;
+    }
+    if (progress > 1.0f) progress = 1.0f;
+    if (progress - *lastProgress >= PROGRESS_STEP || (progress >= 1.0f && *lastProgress < 1.0f)) {
+        *lastProgress = progress;
+        ctl->on_progress(ctl->opaque, progress);
+    }
+}
+
+static void consumeIo(const MergeControl *ctl, int64_t bytes) {
+    if (ctl && ctl->on_io && bytes > 0) {
+        ctl->on_io(ctl->opaque, bytes);
+    }
+}
+
+int merge_av_files(const char *file1Path, const char *file2Path, const char *outputPath,
+                   const MergeControl *ctl, const char **err_msg) {
+    LOGI("Starting audio-video merge: %s + %s -> %s", file1Path, file2Path, outputPath);
+
+    AVFormatContext *ctx1 = NULL;
+    AVFormatContext *ctx2 = NULL;
+    AVFormatContext *outCtx = NULL;
+    AVStream *videoStream = NULL;
+    AVStream *audioStream = NULL;
+    AVStream *inAudioStream = NULL;
+    int videoStreamIndex = -1;
+    int audioStreamIndex = -1;
+    int64_t videoDuration = 0;
+    MediaInfo info1, info2;
+    int cached1 = 0, cached2 = 0;
+    AVIOInterruptCB interrupt = {interruptCallback, (void *) ctl};
+    double durationSeconds = 0;
+    float lastProgress = 0;
+    AVPacket *packet = NULL;
+    int64_t videoStartPts = AV_NOPTS_VALUE;
+    int64_t audioStartPts = AV_NOPTS_VALUE;
+    int outputOpened = 0;
+    int ret = 0;
+
+    /* Open first file */
+    int ret_code = media_open_input(&ctx1, file1Path, ctl ? &interrupt : NULL, &info1, &cached1);
+    if (ret_code < 0) {
+        char errbuf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret_code, errbuf, AV_ERROR_MAX_STRING_SIZE);
+        LOGE("Failed to open first input file: %s, Error: %s", file1Path, errbuf);
+
+        /* Try to get file format information */
+        AVProbeData probe_data = {0};
+        probe_data.filename = file1Path;
+        probe_data.buf = NULL;
+        probe_data.buf_size = 0;
+
+        const AVInputFormat *fmt = av_probe_input_format(&probe_data, 1);
+        if (fmt) {
+            LOGE("Detected format: %s, Long name: %s", fmt->name, fmt->long_name);
+        } else {
+            LOGE("Could not detect file format");
+        }
+
+        setError(err_msg, "Failed to open first input file");
+        ret = -1;
+        goto end;
+    }
+    if (media_find_stream_info(ctx1, file1Path, &info1, cached1) < 0) {
+        LOGE("Failed to find stream info for first file: %s", file1Path);
+        setError(err_msg, "Failed to find stream info for first file");
+        ret = -2;
+        goto end;
+    }
+
+    /* Open second file */
+    if (media_open_input(&ctx2, file2Path, ctl ? &interrupt : NULL, &info2, &cached2) < 0) {
+        LOGE("Failed to open second input file: %s", file2Path);
+        setError(err_msg, "Failed to open second input file");
+        ret = -3;
+        goto end;
+    }
+    if (media_find_stream_info(ctx2, file2Path, &info2, cached2) < 0) {
+        LOGE("Failed to find stream info for second file: %s", file2Path);
+        setError(err_msg, "Failed to find stream info for second file");
+        ret = -4;
+        goto end;
+    }
+
+    /* Determine which is video file and which is audio file */
+    AVFormatContext *videoCtx, *audioCtx;
+    const MediaInfo *videoInfo, *audioInfo;
+
+    if (info1.video_index >= 0) {
+        videoCtx = ctx1;
+        audioCtx = ctx2;
+        videoInfo = &info1;
+        audioInfo = &info2;
+    } else {
+        videoCtx = ctx2;
+        audioCtx = ctx1;
+        videoInfo = &info2;
+        audioInfo = &info1;
+    }
+
+    /* Allocate packet */
+    packet = av_packet_alloc();
+    if (!packet) {
+        LOGE("Failed to allocate AVPacket memory");
+        setError(err_msg, "Failed to allocate memory for packet");
+        ret = -5;
+        goto end;
+    }
+
+    /* Create output context */
+    avformat_alloc_output_context2(&outCtx, NULL, NULL, outputPath);
+    if (!outCtx) {
+        LOGE("Failed to create output context: %s", outputPath);
+        setError(err_msg, "Failed to create output context");
+        ret = -6;
+        goto end;
+    }
+
+    /* Stream indices come from the probe (or its cache), no need to scan the streams again */
+    videoStreamIndex = videoInfo->video_index;
+    audioStreamIndex = audioInfo->audio_index;
+    if (videoStreamIndex >= 0) {
+        videoDuration = videoCtx->streams[videoStreamIndex]->duration;
+    }
+
+    if (videoStreamIndex == -1 || audioStreamIndex == -1) {
+        LOGE("Video or audio stream not found - Video stream index: %d, Audio stream index: %d", videoStreamIndex, audioStreamIndex);
+        setError(err_msg, "Required video or audio stream not found in input files");
+        ret = -7;
+        goto end;
+    }
+
+    LOGI("Found video stream index: %d, audio stream index: %d", videoStreamIndex, audioStreamIndex);
+
+    /* Duration used for progress and audio truncation, fall back to the container duration */
+    if (videoDuration > 0) {
+        durationSeconds = videoDuration * av_q2d(videoCtx->streams[videoStreamIndex]->time_base);
+    } else if (videoCtx->duration > 0) {
+        durationSeconds = (double) videoCtx->duration / AV_TIME_BASE;
+    }
+
+    /* Add video streams */
+    for (int i = 0; i < videoCtx->nb_streams; i++) {
+        AVStream *inStream = videoCtx->streams[i];
+        if (inStream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) {
+            AVStream *outStream = avformat_new_stream(outCtx, NULL);
+            if (!outStream) {
+                LOGE("Failed to create output video stream");
+                setError(err_msg, "Failed to create output video stream");
+                ret = -8;
+                goto end;
+            }
+            if (avcodec_parameters_copy(outStream->codecpar, inStream->codecpar) < 0) {
+                LOGE("Failed to copy video stream parameters");
+                setError(err_msg, "Failed to copy video stream parameters");
+                ret = -9;
+                goto end;
+            }
+            if (inStream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                videoStream = outStream;
+                /* Copy timebase */
+                outStream->time_base = inStream->time_base;
+            }
+        }
+    }
+
+    /* Add audio stream */
+    inAudioStream = audioCtx->streams[audioStreamIndex];
+    audioStream = avformat_new_stream(outCtx, NULL);
+    if (!audioStream) {
+        LOGE("Failed to create output audio stream");
+        setError(err_msg, "Failed to create output audio stream");
+        ret = -10;
+        goto end;
+    }
+    if (avcodec_parameters_copy(audioStream->codecpar, inAudioStream->codecpar) < 0) {
+        LOGE("Failed to copy audio stream parameters");
+        setError(err_msg, "Failed to copy audio stream parameters");
+        ret = -11;
+        goto end;
+    }
+    audioStream->time_base = inAudioStream->time_base;
+
+    /* Open output file */
+    if (!(outCtx->oformat->flags & AVFMT_NOFILE)) {
+        if (avio_open2(&outCtx->pb, outputPath, AVIO_FLAG_WRITE,
+                       ctl ? &interrupt : NULL, NULL) < 0) {
+            LOGE("Failed to open output file: %s", outputPath);
+            setError(err_msg, "Failed to open output file for writing");
+            ret = -12;
+            goto end;
+        }
+        outputOpened = 1;
+    }
+
+    /* Write file header */
+    if (avformat_write_header(outCtx, NULL) < 0) {
+        LOGE("Failed to write file header");
+        setError(err_msg, "Failed to write output file header");
+        ret = -13;
+        goto end;
+    }
+
+    /*
+     * Video is muxed before audio, so each pass accounts for half of the
+     * progress range.
+     */
+
+    /* Write video data first */
+    while (av_read_frame(videoCtx, packet) >= 0) {
+        if (isCancelled(ctl)) {
+            av_packet_unref(packet);
+            break;
+        }
+        /* Every packet read counts against the budget, muxed ones count again below */
+        consumeIo(ctl, packet->size);
+        if (packet->stream_index == videoStreamIndex) {
+            /* Record PTS of the first video frame */
+            if (videoStartPts == AV_NOPTS_VALUE) {
+                videoStartPts = packet->pts;
+            }
+
+            /* Adjust PTS and DTS */
+            packet->pts -= videoStartPts;
+            if (packet->dts != AV_NOPTS_VALUE) {
+                packet->dts -= videoStartPts;
+            }
+
+            if (durationSeconds > 0) {
+                double t = packet->pts * av_q2d(videoCtx->streams[videoStreamIndex]->time_base);
+                reportProgress(ctl, &lastProgress, (float) (0.5 * t / durationSeconds));
+            }
+            consumeIo(ctl, packet->size);
+
+            packet->stream_index = videoStream->index;
+            av_write_frame(outCtx, packet);
+        }
+        av_packet_unref(packet);
+    }
+
+    /* Write audio data */
+    while (!isCancelled(ctl) && av_read_frame(audioCtx, packet) >= 0) {
+        consumeIo(ctl, packet->size);
+        if (packet->stream_index == audioStreamIndex) {
+            /* Record PTS of the first audio frame */
+            if (audioStartPts == AV_NOPTS_VALUE) {
+                audioStartPts = packet->pts;
+            }
+
+            /* Adjust audio PTS and DTS */
+            packet->pts -= audioStartPts;
+            if (packet->dts != AV_NOPTS_VALUE) {
+                packet->dts -= audioStartPts;
+            }
+
+            /*
+             * Ensure audio duration doesn't exceed video duration. durationSeconds
+             * is the video stream duration when the header has one, otherwise the
+             * container's; without either the audio is kept whole.
+             */
+            if (durationSeconds > 0 &&
+                packet->pts * av_q2d(audioStream->time_base) > durationSeconds) {
+                break;
+            }
+
+            if (durationSeconds > 0) {
+                double t = packet->pts * av_q2d(inAudioStream->time_base);
+                reportProgress(ctl, &lastProgress, (float) (0.5 + 0.5 * t / durationSeconds));
+            }
+            consumeIo(ctl, packet->size);
+
+            packet->stream_index = audioStream->index;
+            av_write_frame(outCtx, packet);
+        }
+        av_packet_unref(packet);
+    }
+
+    if (isCancelled(ctl)) {
+        LOGI("Audio-video merge cancelled: %s", outputPath);
+        setError(err_msg, "Merge cancelled");
+        ret = MERGE_ERR_CANCELLED;
+        goto end;
+    }
+
+    /* Write file trailer */
+    if (av_write_trailer(outCtx) < 0) {
+        LOGE("Failed to write file trailer");
+        ret = -14;
+    } else if (ret == 0) {
+        reportProgress(ctl, &lastProgress, 1.0f);
+        LOGI("Audio-video merge completed successfully: %s", outputPath);
+    }
+
+end:
+    /* Interrupted I/O surfaces as an ordinary failure, report it as a cancellation */
+    if (ret != 0 && isCancelled(ctl)) {
+        setError(err_msg, "Merge cancelled");
+        ret = MERGE_ERR_CANCELLED;
+    }
+    if (ret != 0 && ret != MERGE_ERR_CANCELLED) {
+        LOGE("Audio-video merge failed with error code: %d", ret);
+    }
+    /* Cleanup resources */
+    if (packet) av_packet_free(&packet);
+    if (ctx1) avformat_close_input(&ctx1);
+    if (ctx2) avformat_close_input(&ctx2);
+    if (outCtx) {
+        if (!(outCtx->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&outCtx->pb);
+        }
+        avformat_free_context(outCtx);
+    }
+    /* Don't leave a truncated file behind after a cancelled merge */
+    if (ret == MERGE_ERR_CANCELLED && outputOpened) {
+        remove(outputPath);
+    }
+    return ret;
+}
@@ -0,0 +1,31 @@
+#ifndef YAAD_MERGE_H
+#define YAAD_MERGE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define MERGE_ERR_CANCELLED (-15)
+
+/*
+ * Hooks for a running merge. Every field is optional; a zeroed MergeControl
+ * makes merge_av_files behave like a plain blocking remux.
+ */
+typedef struct MergeControl {
+    /* Non-zero aborts the merge at the next packet or blocking I/O call */
+    atomic_int *cancelled;
+    /* Fraction in [0, 1] based on muxed packet timestamps against the video duration */
+    void (*on_progress)(void *opaque, float progress);
+    /* Called with the payload size of every packet read and again for every packet muxed, may block to throttle I/O */
+    void (*on_io)(void *opaque, int64_t bytes);
+    void *opaque;
+} MergeControl;
+
+/*
+ * Remux the video stream(s) of one input with the first audio stream of the
+ * other into out. Returns 0 on success or a negative error code, in which
+ * case err_msg (if not NULL) points to a static description.
+ */
+int merge_av_files(const char *file1Path, const char *file2Path, const char *outputPath,
+                   const MergeControl *ctl, const char **err_msg);
+
+#endif /* YAAD_MERGE_H */
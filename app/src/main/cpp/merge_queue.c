@@ -0,0 +1,323 @@
+#include "merge_queue.h"
+#include "merge.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <android/log.h>
+
+#define LOG_TAG "FFmpegMergeQueue"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+/* Flash storage rarely benefits from more than two concurrent remuxes */
+#define MAX_AUTO_WORKERS 2
+/* Upper bound of a single throttle sleep so cancellation stays responsive */
+#define THROTTLE_SLICE_US 50000
+
+typedef struct MergeJob {
+    merge_job_id_t id;
+    int priority;
+    char *video;
+    char *audio;
+    char *out;
+    atomic_int cancelled;
+    MergeQueue *queue;
+    struct MergeJob *next;
+} MergeJob;
+
+struct MergeQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    MergeJob *pending;
+    MergeJob *running;
+    int stopping;
+    merge_job_id_t next_id;
+    int worker_count;
+    /* Workers that reported back from on_thread_start, and how many of them succeeded */
+    int reported_workers;
+    int ready_workers;
+    pthread_cond_t ready_cond;
+    pthread_t *workers;
+    MergeQueueCallbacks callbacks;
+
+    /* Pacing shared by every worker: the time at which the budget is free again */
+    pthread_mutex_t io_lock;
+    int64_t io_bytes_per_second;
+    int64_t io_next_free_us;
+};
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void free_job(MergeJob *job) {
+    free(job->video);
+    free(job->audio);
+    free(job->out);
+    free(job);
+}
+
+static void unlink_job(MergeJob **list, MergeJob *job) {
+    for (MergeJob **it = list; *it; it = &(*it)->next) {
+        if (*it == job) {
+            *it = job->next;
+            job->next = NULL;
+            return;
+        }
+    }
+}
+
+static void job_progress(void *opaque, float progress) {
+    MergeJob *job = opaque;
+    if (job->queue->callbacks.on_progress) {
+        job->queue->callbacks.on_progress(job->id, progress);
+    }
+}
+
+static void job_consume_io(void *opaque, int64_t bytes) {
+    MergeJob *job = opaque;
+    MergeQueue *queue = job->queue;
+
+    pthread_mutex_lock(&queue->io_lock);
+    int64_t rate = queue->io_bytes_per_second;
+    if (rate <= 0) {
+        pthread_mutex_unlock(&queue->io_lock);
+        return;
+    }
+    int64_t now = now_us();
+    if (queue->io_next_free_us < now) {
+        queue->io_next_free_us = now;
+    }
+    int64_t wait = queue->io_next_free_us - now;
+    queue->io_next_free_us += bytes * 1000000 / rate;
+    pthread_mutex_unlock(&queue->io_lock);
+
+    while (wait > 0 && !atomic_load(&job->cancelled)) {
+        int64_t slice = wait > THROTTLE_SLICE_US ? THROTTLE_SLICE_US : wait;
+        usleep((useconds_t) slice);
+        wait -= slice;
+    }
+}
+
+static void *worker_main(void *arg) {
+    MergeQueue *queue = arg;
+    int ok = !queue->callbacks.on_thread_start || queue->callbacks.on_thread_start() == 0;
+
+    pthread_mutex_lock(&queue->lock);
+    queue->reported_workers++;
+    if (ok) queue->ready_workers++;
+    pthread_cond_broadcast(&queue->ready_cond);
+    pthread_mutex_unlock(&queue->lock);
+    if (!ok) {
+        LOGE("Merge worker failed to start, leaving it out of the pool");
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        while (!queue->stopping && !queue->pending) {
+            pthread_cond_wait(&queue->cond, &queue->lock);
+        }
+        if (queue->stopping) {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        MergeJob *job = queue->pending;
+        queue->pending = job->next;
+        job->next = queue->running;
+        queue->running = job;
+        pthread_mutex_unlock(&queue->lock);
+
+        MergeControl ctl = {
+            .cancelled = &job->cancelled,
+            .on_progress = job_progress,
+            .on_io = job_consume_io,
+            .opaque = job,
+        };
+        const char *err_msg = NULL;
+        int result = merge_av_files(job->video, job->audio, job->out, &ctl, &err_msg);
+
+        pthread_mutex_lock(&queue->lock);
+        unlink_job(&queue->running, job);
+        pthread_mutex_unlock(&queue->lock);
+
+        if (queue->callbacks.on_finish) {
+            queue->callbacks.on_finish(job->id, result, err_msg);
+        }
+        free_job(job);
+    }
+
+    if (queue->callbacks.on_thread_stop) {
+        queue->callbacks.on_thread_stop();
+    }
+    return NULL;
+}
+
+static int default_worker_count(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    long workers = cores / 2;
+    if (workers < 1) workers = 1;
+    if (workers > MAX_AUTO_WORKERS) workers = MAX_AUTO_WORKERS;
+    return (int) workers;
+}
+
+MergeQueue *merge_queue_create(int workers, int64_t io_bytes_per_second,
+                               const MergeQueueCallbacks *callbacks) {
+    MergeQueue *queue = calloc(1, sizeof(MergeQueue));
+    if (!queue) {
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    pthread_cond_init(&queue->ready_cond, NULL);
+    pthread_mutex_init(&queue->io_lock, NULL);
+    queue->next_id = 1;
+    queue->io_bytes_per_second = io_bytes_per_second;
+    if (callbacks) {
+        queue->callbacks = *callbacks;
+    }
+
+    if (workers <= 0) {
+        workers = default_worker_count();
+    }
+    queue->workers = calloc((size_t) workers, sizeof(pthread_t));
+    if (!queue->workers) {
+        merge_queue_destroy(queue);
+        return NULL;
+    }
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&queue->workers[i], NULL, worker_main, queue) != 0) {
+            LOGE("Failed to start merge worker %d", i);
+            break;
+        }
+        queue->worker_count++;
+    }
+
+    /* Jobs queued on a pool without a usable worker would never finish */
+    pthread_mutex_lock(&queue->lock);
+    while (queue->reported_workers < queue->worker_count) {
+        pthread_cond_wait(&queue->ready_cond, &queue->lock);
+    }
+    int ready = queue->ready_workers;
+    pthread_mutex_unlock(&queue->lock);
+    if (ready == 0) {
+        merge_queue_destroy(queue);
+        return NULL;
+    }
+    LOGI("Merge queue started with %d workers", ready);
+    return queue;
+}
+
+void merge_queue_destroy(MergeQueue *queue) {
+    if (!queue) {
+        return;
+    }
+    pthread_mutex_lock(&queue->lock);
+    queue->stopping = 1;
+    MergeJob *pending = queue->pending;
+    queue->pending = NULL;
+    for (MergeJob *job = queue->running; job; job = job->next) {
+        atomic_store(&job->cancelled, 1);
+    }
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+
+    while (pending) {
+        MergeJob *next = pending->next;
+        if (queue->callbacks.on_finish) {
+            queue->callbacks.on_finish(pending->id, MERGE_ERR_CANCELLED, "Merge cancelled");
+        }
+        free_job(pending);
+        pending = next;
+    }
+
+    for (int i = 0; i < queue->worker_count; i++) {
+        pthread_join(queue->workers[i], NULL);
+    }
+    free(queue->workers);
+    pthread_mutex_destroy(&queue->io_lock);
+    pthread_cond_destroy(&queue->ready_cond);
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue);
+}
+
+void merge_queue_set_io_budget(MergeQueue *queue, int64_t io_bytes_per_second) {
+    pthread_mutex_lock(&queue->io_lock);
+    queue->io_bytes_per_second = io_bytes_per_second;
+    queue->io_next_free_us = 0;
+    pthread_mutex_unlock(&queue->io_lock);
+}
+
+merge_job_id_t merge_queue_submit(MergeQueue *queue, const char *video, const char *audio,
+                                  const char *out, int priority) {
+    MergeJob *job = calloc(1, sizeof(MergeJob));
+    if (!job) {
+        return -1;
+    }
+    job->video = strdup(video);
+    job->audio = strdup(audio);
+    job->out = strdup(out);
+    if (!job->video || !job->audio || !job->out) {
+        free_job(job);
+        return -1;
+    }
+    job->priority = priority;
+    job->queue = queue;
+    atomic_init(&job->cancelled, 0);
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->stopping) {
+        pthread_mutex_unlock(&queue->lock);
+        free_job(job);
+        return -1;
+    }
+    job->id = queue->next_id++;
+    MergeJob **it = &queue->pending;
+    while (*it && (*it)->priority >= priority) {
+        it = &(*it)->next;
+    }
+    job->next = *it;
+    *it = job;
+    merge_job_id_t id = job->id;
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return id;
+}
+
+int merge_queue_cancel(MergeQueue *queue, merge_job_id_t id) {
+    MergeJob *removed = NULL;
+    int found = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    for (MergeJob *job = queue->pending; job; job = job->next) {
+        if (job->id == id) {
+            unlink_job(&queue->pending, job);
+            removed = job;
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        for (MergeJob *job = queue->running; job; job = job->next) {
+            if (job->id == id) {
+                atomic_store(&job->cancelled, 1);
+                found = 1;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    if (removed) {
+        if (queue->callbacks.on_finish) {
+            queue->callbacks.on_finish(removed->id, MERGE_ERR_CANCELLED, "Merge cancelled");
+        }
+        free_job(removed);
+    }
+    return found;
+}
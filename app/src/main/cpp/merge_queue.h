@@ -0,0 +1,49 @@
+#ifndef YAAD_MERGE_QUEUE_H
+#define YAAD_MERGE_QUEUE_H
+
+#include <stdint.h>
+
+typedef int64_t merge_job_id_t;
+
+/*
+ * Callbacks invoked on the worker threads. on_thread_start/on_thread_stop
+ * bracket the lifetime of every worker, e.g. to attach it to the JVM. A
+ * worker whose on_thread_start returns non-zero exits without taking jobs.
+ */
+typedef struct MergeQueueCallbacks {
+    int (*on_thread_start)(void);
+    void (*on_thread_stop)(void);
+    void (*on_progress)(merge_job_id_t id, float progress);
+    /* result is 0, a merge_av_files error code or MERGE_ERR_CANCELLED */
+    void (*on_finish)(merge_job_id_t id, int result, const char *err_msg);
+} MergeQueueCallbacks;
+
+typedef struct MergeQueue MergeQueue;
+
+/*
+ * workers <= 0 picks a count from the number of cores, capped because
+ * remuxing is bound by storage rather than CPU. io_bytes_per_second <= 0
+ * disables throttling. The budget counts packet payload read from both
+ * inputs plus payload written to the output, container overhead excluded.
+ * Returns NULL if no worker could be started.
+ */
+MergeQueue *merge_queue_create(int workers, int64_t io_bytes_per_second,
+                               const MergeQueueCallbacks *callbacks);
+
+/* Cancels every job and joins the workers */
+void merge_queue_destroy(MergeQueue *queue);
+
+/* Shared budget for all running merges, applied from the next packet */
+void merge_queue_set_io_budget(MergeQueue *queue, int64_t io_bytes_per_second);
+
+/* Higher priority runs first, equal priorities run in submission order. Returns -1 on failure */
+merge_job_id_t merge_queue_submit(MergeQueue *queue, const char *video, const char *audio,
+                                  const char *out, int priority);
+
+/*
+ * A pending job is dropped and finishes with MERGE_ERR_CANCELLED right away,
+ * a running one stops at its next packet. Returns 0 if the job was not found.
+ */
+int merge_queue_cancel(MergeQueue *queue, merge_job_id_t id);
+
+#endif /* YAAD_MERGE_QUEUE_H */
@@ -20,6 +20,7 @@ import java.util.concurrent.ConcurrentHashMap
 import java.util.concurrent.LinkedBlockingQueue
 import java.util.concurrent.ThreadPoolExecutor
 import java.util.concurrent.TimeUnit
+import java.util.concurrent.atomic.AtomicLong
 import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.SupervisorJob
@@ -158,6 +159,9 @@ object DownloadManager : IDownloadListener {
         }
     }
 
+    // Merge I/O allowed while downloads are running, so remuxing doesn't starve them
+    private const val MERGE_IO_BUDGET_WHILE_DOWNLOADING = 8L * 1024 * 1024
+
     private lateinit var context: Application
     private lateinit var dbHelper: DownloadDatabaseHelper
     private val dispatcher =
@@ -434,11 +438,24 @@ object DownloadManager : IDownloadListener {
                                                 "${title}.mp4"
                                             )
                                             .absolutePath
-                                    FFmpegTools.mergeAV(
-                                        medias[0],
-                                        medias[1],
-                                        mergeAt
-                                    )
+                                    updateMergeIoBudget()
+                                    val result =
+                                        FFmpegTools.mergeAVQueued(
+                                            medias[0],
+                                            medias[1],
+                                            mergeAt
+                                        ) {
+                                            // Not every session reports stopping, re-check while merging
+                                            updateMergeIoBudget()
+                                        }
+                                    if (result != 0) {
+                                        dbHelper.updateDownloadState(
+                                            record.sessionId,
+                                            DownloadState.ERROR
+                                        )
+                                        checkAndControlService()
+                                        return@launch
+                                    }
                                     withContext(Dispatchers.IO) {
                                         media1.delete()
                                         media2.delete()
@@ -594,13 +611,44 @@ object DownloadManager : IDownloadListener {
                             (state == DownloadState.DOWNLOADING ||
                                 state == DownloadState.PENDING)
                     }
+                    is BtDownloadRecord -> {
+                        // Torrent status always reports DOWNLOADING, judge by the transfer itself
+                        val status = record.session?.getStatus()
+                        status != null &&
+                            status.totalSize > 0 &&
+                            status.totalDownloaded < status.totalSize &&
+                            status.downloadSpeed > 0.0
+                    }
                     else -> false
                 }
             }
         }
     }
 
-    private fun checkAndControlService() {}
+    private val mergeIoLock = Any()
+    private val mergeIoReadings = AtomicLong()
+    private var mergeIoAppliedReading = 0L
+    private var mergeIoThrottled: Boolean? = null
+
+    private fun updateMergeIoBudget() {
+        // Session status is read outside the lock because session listeners
+        // call back in here; of racing updates only the latest reading applies
+        val reading = mergeIoReadings.incrementAndGet()
+        val throttle = hasActiveTasks()
+        synchronized(mergeIoLock) {
+            if (reading < mergeIoAppliedReading) return
+            mergeIoAppliedReading = reading
+            if (mergeIoThrottled == throttle) return
+            mergeIoThrottled = throttle
+            FFmpegTools.setMergeIoBudget(
+                if (throttle) MERGE_IO_BUDGET_WHILE_DOWNLOADING else 0
+            )
+        }
+    }
+
+    private fun checkAndControlService() {
+        updateMergeIoBudget()
+    }
 
     override fun onComplete(session: IDownloadSession) {
         super.onComplete(session)
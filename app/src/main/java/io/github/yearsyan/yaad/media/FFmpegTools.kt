@@ -1,7 +1,23 @@
 package io.github.yearsyan.yaad.media
 
+import androidx.annotation.Keep
+import kotlin.coroutines.resume
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.suspendCancellableCoroutine
+import kotlinx.coroutines.withContext
+
+interface MergeListener {
+    fun onProgress(jobId: Long, progress: Float) {}
+
+    fun onFinish(jobId: Long, result: Int, errorMessage: String?)
+}
+
 object FFmpegTools : IMediaTools {
 
+    const val MERGE_CANCELLED = -15
+
+    private val mergeListeners = HashMap<Long, MergeListener>()
+
     external override fun mergeAV(
         video: String,
         audio: String,
@@ -10,5 +26,106 @@ object FFmpegTools : IMediaTools {
 
     external fun configuration(): String
 
+    /**
+     * Stream metadata read with tight probe limits. Results are cached by
+     * path, size and mtime and reused by merges. Null if the file can't be
+     * read.
+     */
+    external fun probe(path: String): MediaInfo?
+
+    suspend fun probeMedia(path: String): MediaInfo? =
+        withContext(Dispatchers.IO) { probe(path) }
+
+    /**
+     * Starts the merge worker pool, [workers] <= 0 sizes it from the core
+     * count. Once started only [ioBytesPerSecond] is applied.
+     */
+    external fun initMergeQueue(workers: Int, ioBytesPerSecond: Long)
+
+    /**
+     * Bytes per second shared by all running merges, <= 0 disables
+     * throttling. Counts payload read from the inputs plus payload written
+     * to the output. May be set before the queue has started.
+     */
+    external fun setMergeIoBudget(ioBytesPerSecond: Long)
+
+    private external fun submitMerge(
+        video: String,
+        audio: String,
+        out: String,
+        priority: Int
+    ): Long
+
+    external fun cancelMerge(jobId: Long): Boolean
+
+    /** Queues a merge and returns its job id, or -1 if it was rejected */
+    fun enqueueMerge(
+        video: String,
+        audio: String,
+        out: String,
+        priority: Int = 0,
+        listener: MergeListener
+    ): Long {
+        // Hold the lock so a fast job can't finish before its listener is known
+        synchronized(mergeListeners) {
+            val id = submitMerge(video, audio, out, priority)
+            if (id >= 0) {
+                mergeListeners[id] = listener
+            }
+            return id
+        }
+    }
+
+    /** Runs the merge on the queue, cancelling the job with the coroutine */
+    suspend fun mergeAVQueued(
+        video: String,
+        audio: String,
+        out: String,
+        priority: Int = 0,
+        onProgress: (Float) -> Unit = {}
+    ): Int = suspendCancellableCoroutine { cont ->
+        val id =
+            enqueueMerge(
+                video,
+                audio,
+                out,
+                priority,
+                object : MergeListener {
+                    override fun onProgress(jobId: Long, progress: Float) {
+                        onProgress(progress)
+                    }
+
+                    override fun onFinish(
+                        jobId: Long,
+                        result: Int,
+                        errorMessage: String?
+                    ) {
+                        if (cont.isActive) {
+                            cont.resume(result)
+                        }
+                    }
+                }
+            )
+        if (id < 0) {
+            cont.resume(-1)
+        } else {
+            cont.invokeOnCancellation { cancelMerge(id) }
+        }
+    }
+
+    @Keep
+    @JvmStatic
+    fun onMergeProgress(jobId: Long, progress: Float) {
+        val listener = synchronized(mergeListeners) { mergeListeners[jobId] }
+        listener?.onProgress(jobId, progress)
+    }
+
+    @Keep
+    @JvmStatic
+    fun onMergeFinish(jobId: Long, result: Int, errorMessage: String?) {
+        val listener = synchronized(mergeListeners) { mergeListeners.remove(jobId) }
+        listener?.onFinish(jobId, result, errorMessage)
+    }
+
     override fun mergeSplice(filePathList: Array<String>, out: String) {}
 }
@@ -0,0 +1,74 @@
+package io.github.yearsyan.yaad.media
+
+import androidx.annotation.Keep
+
+data class MediaStreamInfo(
+    val index: Int,
+    val type: String,
+    val codecName: String,
+    val width: Int,
+    val height: Int,
+    val sampleRate: Int,
+    val channels: Int,
+    val bitRate: Long,
+    val durationUs: Long
+) {
+    companion object {
+        @Keep
+        @JvmStatic
+        fun create(
+            index: Int,
+            type: String,
+            codecName: String,
+            width: Int,
+            height: Int,
+            sampleRate: Int,
+            channels: Int,
+            bitRate: Long,
+            durationUs: Long
+        ): MediaStreamInfo {
+            return MediaStreamInfo(
+                index = index,
+                type = type,
+                codecName = codecName,
+                width = width,
+                height = height,
+                sampleRate = sampleRate,
+                channels = channels,
+                bitRate = bitRate,
+                durationUs = durationUs
+            )
+        }
+    }
+}
+
+data class MediaInfo(
+    val formatName: String,
+    val durationUs: Long,
+    val bitRate: Long,
+    val streams: List<MediaStreamInfo>
+) {
+    val video: MediaStreamInfo?
+        get() = streams.firstOrNull { it.type == "video" }
+
+    val audio: MediaStreamInfo?
+        get() = streams.firstOrNull { it.type == "audio" }
+
+    companion object {
+        @Keep
+        @JvmStatic
+        fun create(
+            formatName: String,
+            durationUs: Long,
+            bitRate: Long,
+            streams: Array<MediaStreamInfo>
+        ): MediaInfo {
+            return MediaInfo(
+                formatName = formatName,
+                durationUs = durationUs,
+                bitRate = bitRate,
+                streams = streams.toList()
+            )
+        }
+    }
+}
@@ -49,6 +49,20 @@ namespace yaad {
         return task_id;
     }
 
+    extern "C" jlong JNICALL native_add_task_file(JNIEnv *env, jobject thiz,
+                                            jstring file, jstring save_at) {
+        auto service = get_service(env, thiz);
+        if (service == nullptr)  {
+            return -1;
+        }
+        auto file_c_str = env->GetStringUTFChars(file, nullptr);
+        auto path_c_str = env->GetStringUTFChars(save_at, nullptr);
+        auto task_id = service->add_task_by_torrent_file(file_c_str, path_c_str);
+        env->ReleaseStringUTFChars(file, file_c_str);
+        env->ReleaseStringUTFChars(save_at, path_c_str);
+        return task_id;
+    }
+
     extern "C"  void JNICALL native_init_service(JNIEnv *env, jobject thiz) {
         auto service = new yaad::BtService();
         auto field_id = env->GetFieldID(env->GetObjectClass(thiz), "ptr", "J");
@@ -113,14 +127,39 @@ namespace yaad {
         service->task_remove(task_id);
     }
 
+    extern "C" jboolean JNICALL native_add_url_seed(JNIEnv *env, jobject thiz, jlong task_id, jstring url) {
+        auto service = get_service(env, thiz);
+        if (service == nullptr)  {
+            return JNI_FALSE;
+        }
+        auto url_c_str = env->GetStringUTFChars(url, nullptr);
+        auto ok = service->add_url_seed(task_id, url_c_str);
+        env->ReleaseStringUTFChars(url, url_c_str);
+        return ok ? JNI_TRUE : JNI_FALSE;
+    }
+
+    extern "C" jboolean JNICALL native_add_http_seed(JNIEnv *env, jobject thiz, jlong task_id, jstring url) {
+        auto service = get_service(env, thiz);
+        if (service == nullptr)  {
+            return JNI_FALSE;
+        }
+        auto url_c_str = env->GetStringUTFChars(url, nullptr);
+        auto ok = service->add_http_seed(task_id, url_c_str);
+        env->ReleaseStringUTFChars(url, url_c_str);
+        return ok ? JNI_TRUE : JNI_FALSE;
+    }
+
     static JNINativeMethod methods[] = {
             {"initService",  "()V",  (void*) native_init_service},
             {"addTaskByLink","(Ljava/lang/String;Ljava/lang/String;)J", (void*) native_add_task_link},
+            {"addTaskByFile","(Ljava/lang/String;Ljava/lang/String;)J", (void*) native_add_task_file},
             {"getTaskStatus",  "(J)Lio/github/yaad/downloader_core/torrent/TorrentDownloadStatus;", (void*) native_get_task_status},
             {"torrentUpdate", "()V", (void*) native_torrent_update},
             {"taskPause", "(J)V", (void*) native_task_pause},
             {"taskResume", "(J)V", (void*) native_task_resume},
-            {"taskRemove", "(J)V", (void*) native_task_remove}
+            {"taskRemove", "(J)V", (void*) native_task_remove},
+            {"addUrlSeed", "(JLjava/lang/String;)Z", (void*) native_add_url_seed},
+            {"addHttpSeed", "(JLjava/lang/String;)Z", (void*) native_add_http_seed}
     };
 
     int register_bt(JNIEnv* env) {
@@ -148,6 +187,8 @@ namespace yaad {
         settings.set_bool(lt::settings_pack::enable_outgoing_utp, true);
         settings.set_bool(lt::settings_pack::enable_incoming_utp, true);
         settings.set_bool(lt::settings_pack::enable_ip_notifier, true);
+        // 小 swarm 时 web seed 可能是主要来源, 放宽每个 web seed 的连接数
+        settings.set_int(lt::settings_pack::max_web_seed_connections, 6);
 
         session_ = std::make_unique<lt::session>(settings);
     }
@@ -159,10 +200,34 @@ namespace yaad {
             std::cerr << "解析 magnet 失败: " << ec.message() << "\n";
             return -1;
         }
+        // ws= 参数已由 parse_magnet_uri 放入 url_seeds, 与 swarm 一起调度
+        if (!atp.url_seeds.empty()) {
+            LOGI("magnet carries %zu web seeds", atp.url_seeds.size());
+        }
         atp.save_path = path;  // 下载保存路径
-        atp.flags |= lt::torrent_flags::seed_mode;
+        return add_task(std::move(atp));
+    }
 
-        return put_handle(session_->add_torrent(atp, ec));
+    task_id_t BtService::add_task_by_torrent_file(const char* file, const char* path) {
+        lt::error_code ec;
+        lt::add_torrent_params atp;
+        atp.ti = std::make_shared<lt::torrent_info>(std::string(file), ec);
+        if (ec) {
+            LOGI("failed to load torrent %s: %s", file, ec.message().c_str());
+            return -1;
+        }
+        atp.save_path = path;
+        return add_task(std::move(atp));
+    }
+
+    task_id_t BtService::add_task(lt::add_torrent_params&& atp) {
+        lt::error_code ec;
+        auto handle = session_->add_torrent(std::move(atp), ec);
+        if (ec) {
+            LOGI("failed to add torrent: %s", ec.message().c_str());
+            return -1;
+        }
+        return put_handle(std::move(handle));
     }
 
     std::unique_ptr<libtorrent::torrent_status> BtService::get_task_info(task_id_t task_id) {
@@ -217,4 +282,22 @@ namespace yaad {
         tasks_table_.erase(task_id);
     }
 
+    bool BtService::add_url_seed(task_id_t task_id, const char* url) {
+        auto handle = get_handle(task_id);
+        if (handle == nullptr || url == nullptr || *url == '\0') {
+            return false;
+        }
+        handle->add_url_seed(url);
+        return true;
+    }
+
+    bool BtService::add_http_seed(task_id_t task_id, const char* url) {
+        auto handle = get_handle(task_id);
+        if (handle == nullptr || url == nullptr || *url == '\0') {
+            return false;
+        }
+        handle->add_http_seed(url);
+        return true;
+    }
+
 }
\ No newline at end of file
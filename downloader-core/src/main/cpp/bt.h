@@ -15,12 +15,18 @@ namespace yaad {
     public:
         BtService();
         task_id_t add_task_by_magnet_uri(const char* uri, const char* path);
+        task_id_t add_task_by_torrent_file(const char* file, const char* path);
         std::unique_ptr<libtorrent::torrent_status> get_task_info(task_id_t task_id);
         void update_torrent(std::function<void (task_id_t task,const libtorrent::torrent_status& status)> cb);
         void task_pause(task_id_t task_id);
         void task_resume(task_id_t task_id);
         void task_remove(task_id_t task_id);
+        // BEP 19 web seed, a plain HTTP/FTP server holding the payload
+        bool add_url_seed(task_id_t task_id, const char* url);
+        // BEP 17 http seed, a server answering piece requests by info-hash
+        bool add_http_seed(task_id_t task_id, const char* url);
     private:
+        task_id_t add_task(libtorrent::add_torrent_params&& atp);
         inline task_id_t create_id() {
             return _id.fetch_add(1);
         }
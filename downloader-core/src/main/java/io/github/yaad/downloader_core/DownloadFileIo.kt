@@ -0,0 +1,102 @@
+package io.github.yaad.downloader_core
+
+import java.io.IOException
+import java.io.RandomAccessFile
+
+// Target file of a ranged download, written by all part workers at once
+internal interface DownloadFileIo {
+    val isOpen: Boolean
+
+    /** Opens [path] with room for [size] bytes, throws IOException on failure */
+    fun open(path: String, size: Long)
+
+    fun write(offset: Long, buffer: ByteArray, start: Int, length: Int)
+
+    /** Flushes written data and trims the file to [size] */
+    fun finish(size: Long)
+
+    fun close()
+}
+
+internal class MmapFileIo : DownloadFileIo {
+    private var fd: Int = -1
+    private var ptr: Long = 0L
+    private var size: Long = 0L
+
+    override val isOpen: Boolean
+        get() = ptr != 0L
+
+    override fun open(path: String, size: Long) {
+        fd = NativeBridge.openFile(path)
+        if (fd == -1) throw IOException("Failed to open file for mmap: $path")
+        ptr = NativeBridge.mmapFile(fd, size)
+        if (ptr == 0L) {
+            NativeBridge.closeFile(fd)
+            fd = -1
+            throw IOException("Failed to mmap file: $path")
+        }
+        this.size = size
+    }
+
+    override fun write(
+        offset: Long,
+        buffer: ByteArray,
+        start: Int,
+        length: Int
+    ) {
+        NativeBridge.writeByteArray(ptr, offset, buffer, start, length)
+    }
+
+    override fun finish(size: Long) {
+        NativeBridge.msync(ptr, size)
+        // mmapFile grows the file to a whole page
+        NativeBridge.resizeFile(fd, size)
+    }
+
+    override fun close() {
+        if (ptr != 0L) NativeBridge.munmap(ptr, size)
+        if (fd != -1) NativeBridge.closeFile(fd)
+        ptr = 0L
+        fd = -1
+    }
+}
+
+// Plain file I/O, used where the native library isn't available
+internal class RandomAccessFileIo : DownloadFileIo {
+    @Volatile private var file: RandomAccessFile? = null
+
+    override val isOpen: Boolean
+        get() = file != null
+
+    override fun open(path: String, size: Long) {
+        file = RandomAccessFile(path, "rw").apply { setLength(size) }
+    }
+
+    override fun write(
+        offset: Long,
+        buffer: ByteArray,
+        start: Int,
+        length: Int
+    ) {
+        val f = file ?: throw IOException("File is not open")
+        // Seek and write must not interleave with another worker
+        synchronized(f) {
+            f.seek(offset)
+            f.write(buffer, start, length)
+        }
+    }
+
+    override fun finish(size: Long) {
+        file?.let {
+            synchronized(it) {
+                it.setLength(size)
+                it.fd.sync()
+            }
+        }
+    }
+
+    override fun close() {
+        file?.close()
+        file = null
+    }
+}
@@ -14,6 +14,7 @@ import io.ktor.utils.io.readAvailable
 import java.io.File
 import java.io.FileOutputStream
 import java.io.IOException
+import java.util.IdentityHashMap
 import kotlinx.coroutines.CancellationException
 import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.Dispatchers
@@ -39,7 +40,7 @@ import kotlinx.serialization.encodeToByteArray
 @Serializable
 data class ThreadPartInfo(
     val start: Long,
-    val end: Long,
+    var end: Long, // moves down when another worker takes over the tail
     var downloaded: Long,
     internal var lastKeyTime: Long = 0,
     internal var lastKeyDownLoad: Long = 0,
@@ -88,12 +89,36 @@ private data class ServerFileInfo(
     val etag: String?
 )
 
-class HttpDownloadSession(
+// One URL serving the payload, either the primary url or a mirror
+private class DownloadSource(val url: String) {
+    @Volatile var speed: Double = 0.0 // bytes per second, smoothed
+    @Volatile var active: Int = 0
+    @Volatile var failures: Int = 0
+
+    fun recordSample(bytes: Long, millis: Long) {
+        if (millis <= 0) return
+        val sample = bytes / (millis / 1000.0)
+        speed = if (speed == 0.0) sample else speed * 0.7 + sample * 0.3
+    }
+}
+
+class HttpDownloadSession
+internal constructor(
     private val url: String,
     private val path: String,
-    private val headers: Map<String, String> = emptyMap(),
-    private val threadCount: Int = 8
+    private val headers: Map<String, String>,
+    private val threadCount: Int,
+    mirrors: List<String>,
+    private val fileIo: DownloadFileIo
 ) : IDownloadSession {
+    constructor(
+        url: String,
+        path: String,
+        headers: Map<String, String> = emptyMap(),
+        threadCount: Int = 8,
+        mirrors: List<String> = emptyList()
+    ) : this(url, path, headers, threadCount, mirrors, MmapFileIo())
+
     companion object {
         val ktorClient =
             HttpClient(CIO) {
@@ -106,6 +131,16 @@ class HttpDownloadSession(
 
         private val defaultHeaders = mapOf("User-Agent" to getSystemUserAgent())
 
+        private const val MAX_SOURCE_FAILURES = 3
+
+        // Also the most a part can be written past its recorded progress
+        private const val WRITE_BUFFER_SIZE = 65536
+
+        // Smallest tail worth moving to another connection
+        private const val MIN_STEAL_SIZE = 512L * 1024
+
+        private val CONTENT_RANGE = Regex("""bytes (\d+)-(\d+)/(\d+|\*)""")
+
         private fun normalizeHeaderKey(key: String): String {
             return key.split("-").joinToString("-") { word ->
                 word.lowercase().replaceFirstChar {
@@ -116,14 +151,20 @@ class HttpDownloadSession(
     }
 
     private val metaFile = File("$path.meta")
-    private var checkpoint: DownloadCheckpoint? = null
-    private var fd: Int = -1
-    private var ptr: Long = 0L
+    // Replaced, never mutated in place, when a part is split
+    @Volatile private var checkpoint: DownloadCheckpoint? = null
+    // Parts a worker is downloading, by identity, with the source of their current connection
+    private val activeParts: MutableMap<ThreadPartInfo, DownloadSource?> =
+        IdentityHashMap()
     private var supportsRange = false
     private val speedUpdateTime: Long = 200 // milliseconds
     @Volatile private var totalFileSize: Long = 0
     @Volatile private var serverEtag: String? = null
 
+    // sources[0] is always the primary url
+    private val sources: MutableList<DownloadSource> =
+        (listOf(url) + mirrors).distinct().map { DownloadSource(it) }.toMutableList()
+
     private val mergedHeaders: Map<String, String> = run {
         val normalizedHeaders =
             headers.mapKeys { (key, _) -> normalizeHeaderKey(key) }
@@ -210,27 +251,13 @@ class HttpDownloadSession(
             return
         }
 
-        if (fd == -1 && totalFileSize > 0) {
-            try {
-                fd = NativeBridge.openFile(path)
-            } catch (e: Exception) {
-                currentState = DownloadState.ERROR
-                currentErrorMessage =
-                    "Failed to open file for mmap: ${e.message}"
-                notifyStateChanged()
-                starResultListener(RuntimeException(currentErrorMessage, e))
-                return
-            }
-        }
-        if (ptr == 0L && totalFileSize > 0 && fd != -1) {
+        if (!fileIo.isOpen && totalFileSize > 0) {
             try {
-                ptr = NativeBridge.mmapFile(fd, totalFileSize)
+                fileIo.open(path, totalFileSize)
             } catch (e: Exception) {
                 currentState = DownloadState.ERROR
-                currentErrorMessage = "Failed to mmap file: ${e.message}"
+                currentErrorMessage = "Failed to open file: ${e.message}"
                 notifyStateChanged()
-                if (fd != -1) NativeBridge.closeFile(fd)
-                fd = -1
                 starResultListener(RuntimeException(currentErrorMessage, e))
                 return
             }
@@ -333,150 +360,37 @@ class HttpDownloadSession(
             }
 
         try {
+            synchronized(activeParts) { activeParts.clear() }
+            val workerCount = if (supportsRange) threadCount.coerceAtLeast(1) else 1
             downloadJobs =
-                currentCheckpoint.parts.mapIndexed { index, part ->
+                List(workerCount) {
                     downloadScope.launch {
-                        val startOffset = part.start + part.downloaded
-                        if (
-                            startOffset > part.end && part.end != -1L
-                        ) { // part.end can be -1 for chunked download initial part
-                            println(
-                                "Part ${index} (${part.start}-${part.end}) already completed."
-                            )
-                            return@launch
-                        }
-
-                        var retryCount = 0
-                        var lastError: IOException? = null
-
-                        while (retryCount < 3 && isActive) {
-                            if (isPaused) {
-                                while (isPaused && isActive) {
-                                    delay(200)
-                                }
-                                if (!isActive) break
-                            }
-                            if (isStopped) break
+                        // Throughput of this worker's last part, sizes what it steals next
+                        var lastSpeed = 0.0
+                        while (
+                            isActive && !isStopped && currentErrorMessage == null
+                        ) {
+                            val part = nextPart(lastSpeed) ?: break
+                            val startedAt = System.currentTimeMillis()
+                            val downloadedBefore = part.downloaded
                             try {
-                                ktorClient
-                                    .prepareGet(url) {
-                                        mergedHeaders.forEach { (k, v) ->
-                                            header(k, v)
-                                        }
-                                        if (supportsRange) {
-                                            header(
-                                                HttpHeaders.Range,
-                                                "bytes=$startOffset-${part.end}"
-                                            )
-                                        }
-                                        if (
-                                            supportsRange &&
-                                                part.downloaded > 0 &&
-                                                currentCheckpoint.etag != null
-                                        ) {
-                                            header(
-                                                HttpHeaders.IfRange,
-                                                currentCheckpoint.etag
-                                            )
-                                        }
-                                    }
-                                    .execute { response ->
-                                        if (
-                                            response.status.value !in 200..299
-                                        ) {
-                                            val errorMsg =
-                                                "HTTP error: ${response.status} for part $index (range $startOffset-${part.end}). ETag used: ${currentCheckpoint.etag}"
-                                            println(errorMsg)
-                                            throw IOException(errorMsg)
-                                        }
-
-                                        val bodyChannel: ByteReadChannel =
-                                            response.body()
-                                        val buffer = ByteArray(65536)
-                                        var mmapWriteOffset = startOffset
-
-                                        while (isActive) {
-                                            while (isPaused && isActive) {
-                                                delay(200)
-                                            }
-                                            if (isStopped || !isActive) break
-
-                                            val read =
-                                                bodyChannel.readAvailable(
-                                                    buffer,
-                                                    0,
-                                                    buffer.size
-                                                )
-                                            if (read == -1) break
-
-                                            if (
-                                                ptr != 0L
-                                            ) { // Ensure mmap pointer is valid for ranged downloads
-                                                NativeBridge.writeByteArray(
-                                                    ptr,
-                                                    mmapWriteOffset,
-                                                    buffer,
-                                                    0,
-                                                    read
-                                                )
-                                            } else {
-                                                println(
-                                                    "Warning: ptr is 0, cannot write with mmap for non-ranged part $index"
-                                                )
-                                            }
-
-                                            mmapWriteOffset += read
-                                            controlMutex.withLock {
-                                                part.downloaded += read
-                                            }
-                                        }
-                                        // If successfully completed, break retry loop
-                                        lastError = null // Clear last error
-                                    }
-                                break
-                            } catch (e: IOException) {
-                                lastError = e
-                                retryCount++
-                                println(
-                                    "Retry attempt $retryCount for part $index after error: ${e.message}"
-                                )
-                                if (retryCount < 3 && isActive) {
-                                    delay(
-                                        1000L * retryCount
-                                    ) // Exponential backoff for retries
-                                }
-                            } catch (e: CancellationException) {
-                                println(
-                                    "Part $index download cancelled via coroutine cancellation."
-                                )
-                                break // Exit retry loop
-                            } catch (
-                                e: Exception) { // Catch other Ktor exceptions
-                                lastError =
-                                    IOException(
-                                        "Ktor client error: ${e.message}",
-                                        e
-                                    )
-                                retryCount++
-                                println(
-                                    "Retry attempt $retryCount for part $index after Ktor client error: ${e.message}"
+                                downloadPart(
+                                    part,
+                                    currentCheckpoint.etag,
+                                    currentCheckpoint.fileSize
                                 )
-                                if (retryCount < 3 && isActive) {
-                                    delay(1000L * retryCount)
+                            } finally {
+                                synchronized(activeParts) {
+                                    activeParts.remove(part)
                                 }
                             }
-                        }
-
-                        if (retryCount == 3 && lastError != null) {
-                            lastError?.let {
-                                val errorMsg =
-                                    "Part $index failed after 3 retries: ${it.message}"
-                                println(errorMsg)
-                                controlMutex.withLock {
-                                    if (currentErrorMessage == null)
-                                        currentErrorMessage = errorMsg
-                                    else currentErrorMessage += "\n$errorMsg"
-                                }
+                            // Without ranges a part can't be picked up where it stopped
+                            if (!supportsRange) break
+                            val elapsed = System.currentTimeMillis() - startedAt
+                            if (elapsed > 0) {
+                                lastSpeed =
+                                    (part.downloaded - downloadedBefore) /
+                                        (elapsed / 1000.0)
                             }
                         }
                     }
@@ -516,7 +430,8 @@ class HttpDownloadSession(
                         )
                     } else {
                         var allPartsCompleted = true
-                        currentCheckpoint.parts.forEach { part ->
+                        // Parts split off while downloading are only in the latest checkpoint
+                        (checkpoint ?: currentCheckpoint).parts.forEach { part ->
                             val expectedToDownload =
                                 if (part.end == -1L) part.downloaded
                                 else (part.end - part.start + 1)
@@ -526,16 +441,10 @@ class HttpDownloadSession(
                         }
 
                         if (allPartsCompleted) {
-                            if (ptr != 0L && currentCheckpoint.fileSize > 0)
-                                NativeBridge.msync(
-                                    ptr,
-                                    currentCheckpoint.fileSize
-                                )
-                            if (fd != -1 && currentCheckpoint.fileSize > 0)
-                                NativeBridge.resizeFile(
-                                    fd,
-                                    currentCheckpoint.fileSize
-                                )
+                            if (
+                                fileIo.isOpen && currentCheckpoint.fileSize > 0
+                            )
+                                fileIo.finish(currentCheckpoint.fileSize)
 
                             if (supportsRange && serverEtag != null) {
                                 currentState = DownloadState.VALIDATING
@@ -612,33 +521,11 @@ class HttpDownloadSession(
                         currentState != DownloadState.COMPLETED &&
                             currentState != DownloadState.PAUSED
                     ) {
-                        if (
-                            ptr != 0L &&
-                                checkpoint != null &&
-                                checkpoint!!.fileSize > 0
-                        ) {
-                            NativeBridge.munmap(ptr, checkpoint!!.fileSize)
-                        }
-                        if (fd != -1) {
-                            NativeBridge.closeFile(fd)
-                        }
-                        ptr = 0L
-                        fd = -1
+                        fileIo.close()
                     } else if (
                         currentState == DownloadState.COMPLETED
                     ) { // Ensure cleanup on completion too
-                        if (
-                            ptr != 0L &&
-                                checkpoint != null &&
-                                checkpoint!!.fileSize > 0
-                        ) {
-                            NativeBridge.munmap(ptr, checkpoint!!.fileSize)
-                        }
-                        if (fd != -1) {
-                            NativeBridge.closeFile(fd)
-                        }
-                        ptr = 0L
-                        fd = -1
+                        fileIo.close()
                         finishListener()
                     }
 
@@ -1159,14 +1046,7 @@ class HttpDownloadSession(
 
             // Resources cleanup (mmap, fd)
             // This was in the finally block of start(), but good to ensure it here too for stop()
-            if (ptr != 0L && checkpoint != null && checkpoint!!.fileSize > 0) {
-                NativeBridge.munmap(ptr, checkpoint!!.fileSize)
-            }
-            if (fd != -1) {
-                NativeBridge.closeFile(fd)
-            }
-            ptr = 0L
-            fd = -1
+            fileIo.close()
 
             // Save checkpoint if supported and download was in a state that warrants it
             if (
@@ -1245,25 +1125,343 @@ class HttpDownloadSession(
 
         // Clear native resources again just in case stop() didn't fully finalize before remove()
         // was called
-        if (ptr != 0L) { // Should be 0L if stop() worked
-            println("Warning: ptr was not 0 during remove. Attempting munmap.")
-            // We need a size for munmap. If checkpoint is null, this is problematic.
-            // This indicates a potential issue in resource lifecycle.
-            // For safety, we might not be able to call munmap if size info is lost.
+        if (fileIo.isOpen) { // Should be closed if stop() worked
+            println("Warning: file was still open during remove. Closing it.")
+            fileIo.close()
         }
-        if (fd != -1) { // Should be -1 if stop() worked
-            println(
-                "Warning: fd was not -1 during remove. Attempting closeFile."
-            )
-            NativeBridge.closeFile(fd)
-            fd = -1
-        }
-        ptr = 0L // Ensure they are reset
 
         println("Download session removed for URL: $url")
         notifyStateChanged() // Notify that the state has changed (e.g., to PENDING or DELETED)
     }
 
+    private suspend fun CoroutineScope.downloadPart(
+        part: ThreadPartInfo,
+        etag: String?,
+        fileSize: Long
+    ) {
+        val index = checkpoint?.parts?.indexOfFirst { it === part } ?: -1
+        var retryCount = 0
+        var lastError: IOException? = null
+        var lastSource: DownloadSource? = null
+
+        while (retryCount < 3 && isActive) {
+            if (isPaused) {
+                while (isPaused && isActive) {
+                    delay(200)
+                }
+                if (!isActive) break
+            }
+            if (isStopped) break
+            // Resume after whatever an earlier attempt already wrote, up to
+            // wherever a steal has moved the end of the part since. Without
+            // range support the body always starts at byte 0, so start over.
+            val (startOffset, end) =
+                controlMutex.withLock {
+                    if (!supportsRange) part.downloaded = 0
+                    Pair(part.start + part.downloaded, part.end)
+                }
+            if (startOffset > end) {
+                println("Part $index ($startOffset-$end) already completed.")
+                return
+            }
+            val source = pickSource(lastSource)
+            lastSource = source
+            synchronized(activeParts) { activeParts[part] = source }
+            val isPrimary = source.url == url
+            try {
+                ktorClient
+                    .prepareGet(source.url) {
+                        mergedHeaders.forEach { (k, v) -> header(k, v) }
+                        if (supportsRange) {
+                            header(HttpHeaders.Range, "bytes=$startOffset-$end")
+                        }
+                        // ETags are per server, only the primary's is known
+                        if (
+                            isPrimary &&
+                                supportsRange &&
+                                part.downloaded > 0 &&
+                                etag != null
+                        ) {
+                            header(HttpHeaders.IfRange, etag)
+                        }
+                    }
+                    .execute { response ->
+                        // Busy or failing servers are ordinary failures, retried elsewhere
+                        if (response.status.value !in 200..299) {
+                            val errorMsg =
+                                "HTTP error: ${response.status} from ${source.url} for part $index (range $startOffset-$end). ETag used: $etag"
+                            println(errorMsg)
+                            throw IOException(errorMsg)
+                        }
+                        if (!isPrimary) {
+                            checkMirrorResponse(
+                                source,
+                                response,
+                                startOffset,
+                                fileSize
+                            )
+                        }
+
+                        val bodyChannel: ByteReadChannel = response.body()
+                        val buffer = ByteArray(WRITE_BUFFER_SIZE)
+                        var writeOffset = startOffset
+                        var sampleStart = System.currentTimeMillis()
+                        var sampleBytes = 0L
+
+                        while (isActive) {
+                            while (isPaused && isActive) {
+                                delay(200)
+                            }
+                            if (isStopped || !isActive) break
+
+                            val read =
+                                bodyChannel.readAvailable(buffer, 0, buffer.size)
+                            if (read == -1) break
+
+                            // Bytes past the current end now belong to a stolen part
+                            val writable =
+                                controlMutex.withLock {
+                                    minOf(
+                                        read.toLong(),
+                                        part.end - writeOffset + 1
+                                    )
+                                }
+                            if (writable > 0) {
+                                if (fileIo.isOpen) {
+                                    fileIo.write(
+                                        writeOffset,
+                                        buffer,
+                                        0,
+                                        writable.toInt()
+                                    )
+                                } else {
+                                    println(
+                                        "Warning: file is not open, cannot write part $index"
+                                    )
+                                }
+                                writeOffset += writable
+                                controlMutex.withLock {
+                                    part.downloaded += writable
+                                }
+                                sampleBytes += writable
+                            }
+
+                            val now = System.currentTimeMillis()
+                            if (now - sampleStart >= 1000) {
+                                source.recordSample(
+                                    sampleBytes,
+                                    now - sampleStart
+                                )
+                                sampleStart = now
+                                sampleBytes = 0
+                            }
+                            if (writable < read) break
+                        }
+                        // Short connections still tell how fast the source is
+                        val elapsed = System.currentTimeMillis() - sampleStart
+                        if (sampleBytes > 0 && elapsed >= speedUpdateTime) {
+                            source.recordSample(sampleBytes, elapsed)
+                        }
+                        // A source closing early is retried, possibly on another source
+                        if (
+                            isActive &&
+                                !isStopped &&
+                                controlMutex.withLock { writeOffset <= part.end }
+                        ) {
+                            throw IOException(
+                                "Connection to ${source.url} closed at $writeOffset before end of part $index (${part.end})"
+                            )
+                        }
+                        // If successfully completed, break retry loop
+                        lastError = null // Clear last error
+                        source.failures = 0
+                    }
+                break
+            } catch (e: IOException) {
+                lastError = e
+                source.failures++
+                retryCount++
+                println(
+                    "Retry attempt $retryCount for part $index after error: ${e.message}"
+                )
+                if (retryCount < 3 && isActive) {
+                    delay(1000L * retryCount) // Exponential backoff for retries
+                }
+            } catch (e: CancellationException) {
+                println(
+                    "Part $index download cancelled via coroutine cancellation."
+                )
+                break // Exit retry loop
+            } catch (e: Exception) { // Catch other Ktor exceptions
+                lastError = IOException("Ktor client error: ${e.message}", e)
+                source.failures++
+                retryCount++
+                println(
+                    "Retry attempt $retryCount for part $index after Ktor client error: ${e.message}"
+                )
+                if (retryCount < 3 && isActive) {
+                    delay(1000L * retryCount)
+                }
+            } finally {
+                releaseSource(source)
+            }
+        }
+
+        if (retryCount == 3 && lastError != null) {
+            lastError?.let {
+                val errorMsg =
+                    "Part $index failed after 3 retries: ${it.message}"
+                println(errorMsg)
+                controlMutex.withLock {
+                    if (currentErrorMessage == null) currentErrorMessage = errorMsg
+                    else currentErrorMessage += "\n$errorMsg"
+                }
+            }
+        }
+    }
+
+    private fun remainingBytes(part: ThreadPartInfo): Long =
+        part.end - (part.start + part.downloaded) + 1
+
+    // Rate of a running part, or of its source while the part has no sample yet
+    private fun partSpeed(part: ThreadPartInfo): Double =
+        if (part.speed > 0.0) part.speed else activeParts[part]?.speed ?: 0.0
+
+    /*
+     * Hands a worker an unfinished part nobody is downloading. Once there is
+     * none left, the tail of the part expected to finish last is split off,
+     * sized by how fast the worker was against that part's speed, so workers
+     * on fast sources end up downloading most of the file. Parts whose speed
+     * is still unknown are not split; if only those are left the worker asks
+     * again after the next speed update.
+     */
+    private suspend fun CoroutineScope.nextPart(workerSpeed: Double): ThreadPartInfo? {
+        while (isActive && !isStopped && currentErrorMessage == null) {
+            var unmeasured = false
+            val part =
+                controlMutex.withLock {
+                    val cp = checkpoint ?: return@withLock null
+                    synchronized(activeParts) {
+                        val idle =
+                            cp.parts.firstOrNull {
+                                !activeParts.containsKey(it) && remainingBytes(it) > 0
+                            }
+                        if (idle != null) {
+                            activeParts[idle] = null
+                            return@withLock idle
+                        }
+                        if (!supportsRange) return@withLock null
+
+                        val candidates =
+                            activeParts.keys.filter {
+                                remainingBytes(it) > MIN_STEAL_SIZE + WRITE_BUFFER_SIZE
+                            }
+                        val victim =
+                            candidates
+                                .filter { partSpeed(it) > 0.0 }
+                                .maxByOrNull { remainingBytes(it) / partSpeed(it) }
+                        if (victim == null) {
+                            unmeasured = candidates.isNotEmpty()
+                            return@withLock null
+                        }
+                        // The victim may be writing one buffer past its recorded progress
+                        val stealable = remainingBytes(victim) - WRITE_BUFFER_SIZE
+                        val victimSpeed = partSpeed(victim)
+                        val share =
+                            if (workerSpeed > 0.0)
+                                workerSpeed / (workerSpeed + victimSpeed)
+                            else 0.5
+                        val size = (stealable * share).toLong()
+                        if (size < MIN_STEAL_SIZE) return@withLock null
+
+                        val stolen =
+                            ThreadPartInfo(victim.end - size + 1, victim.end, 0L)
+                        victim.end = stolen.start - 1
+                        checkpoint = cp.copy(parts = cp.parts + stolen)
+                        activeParts[stolen] = null
+                        println(
+                            "Split ${stolen.start}-${stolen.end} off part ${cp.parts.indexOfFirst { it === victim }}"
+                        )
+                        stolen
+                    }
+                }
+            if (part != null || !unmeasured) return part
+            delay(speedUpdateTime)
+        }
+        return null
+    }
+
+    /**
+     * Adds another URL serving the same payload. Mirrors are only used when
+     * the primary url supports ranges; connections go to the fastest sources
+     * with spare capacity and idle workers take over the tail of slower
+     * parts. Can be called while downloading.
+     *
+     * Mirrors are not part of [DownloadCheckpoint], so a session created to
+     * resume a download has to be given them again.
+     */
+    fun addMirror(mirrorUrl: String) {
+        synchronized(sources) {
+            if (sources.none { it.url == mirrorUrl }) {
+                sources.add(DownloadSource(mirrorUrl))
+            }
+        }
+    }
+
+    // Picks and reserves a source for one connection
+    private fun pickSource(previous: DownloadSource?): DownloadSource =
+        synchronized(sources) {
+            val primary = sources[0]
+            val candidates =
+                if (supportsRange)
+                    sources.filter { it.failures < MAX_SOURCE_FAILURES }
+                else listOf(primary)
+            // After a failure move on to another source if there is one
+            val usable =
+                candidates.filter { it !== previous }.ifEmpty { candidates }
+            // Unmeasured sources are assumed to be as fast as the average one
+            val measured = usable.filter { it.speed > 0.0 }
+            val assumedSpeed =
+                if (measured.isEmpty()) 1.0 else measured.sumOf { it.speed } / measured.size
+            // The source whose connections would be the least loaded wins
+            val picked =
+                usable.minByOrNull { source ->
+                    val speed = if (source.speed > 0.0) source.speed else assumedSpeed
+                    (source.active + 1) / speed
+                } ?: primary
+            picked.active++
+            picked
+        }
+
+    private fun releaseSource(source: DownloadSource) {
+        synchronized(sources) { source.active-- }
+    }
+
+    private fun checkMirrorResponse(
+        source: DownloadSource,
+        response: HttpResponse,
+        expectedStart: Long,
+        expectedSize: Long
+    ) {
+        if (response.status.value != 206) {
+            throw IOException(
+                "Mirror ${source.url} answered ${response.status} instead of a partial response"
+            )
+        }
+        // A mirror serving another range or a file of another size holds
+        // different content and is never used again
+        val contentRange = response.headers[HttpHeaders.ContentRange]
+        val match = contentRange?.trim()?.let { CONTENT_RANGE.matchEntire(it) }
+        val start = match?.groupValues?.get(1)?.toLongOrNull()
+        val total = match?.groupValues?.get(3)?.toLongOrNull()
+        if (start != expectedStart || total != expectedSize) {
+            source.failures = MAX_SOURCE_FAILURES
+            throw IOException(
+                "Mirror ${source.url} rejected: Content-Range $contentRange, expected start $expectedStart and size $expectedSize"
+            )
+        }
+    }
+
     private suspend fun checkSupportForRangeAndGetInfoKtor(
         targetUrl: String
     ): ServerFileInfo {
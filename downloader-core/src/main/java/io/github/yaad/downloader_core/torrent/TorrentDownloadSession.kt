@@ -20,6 +20,8 @@ class TorrentDownloadSession : IDownloadSession {
     private val savePath: String
     private val downloadListeners: HashSet<IDownloadListener> = HashSet()
     private var status: TorrentDownloadStatus? = null
+    private val urlSeeds: LinkedHashSet<String> = LinkedHashSet()
+    private val httpSeeds: LinkedHashSet<String> = LinkedHashSet()
 
     private constructor(
         sourceType: SourceType,
@@ -40,7 +42,10 @@ class TorrentDownloadSession : IDownloadSession {
         ): TorrentDownloadSession {
             val session =
                 TorrentDownloadSession(
-                    sourceType = SourceType.Torrent,
+                    sourceType =
+                        if (link.startsWith("magnet:", ignoreCase = true))
+                            SourceType.Magnet
+                        else SourceType.Torrent,
                     sourceInfo = link,
                     savePath = savePath
                 )
@@ -74,8 +79,39 @@ class TorrentDownloadSession : IDownloadSession {
         starResultListener: (Exception?) -> Unit,
         finishListener: () -> Unit
     ) {
-        if (sourceType == SourceType.Magnet) {
-            taskId = torrentService.addTaskByLink(sourceInfo, savePath)
+        taskId =
+            when (sourceType) {
+                SourceType.Magnet ->
+                    torrentService.addTaskByLink(sourceInfo, savePath)
+                SourceType.Torrent ->
+                    torrentService.addTaskByFile(sourceInfo, savePath)
+            }
+        if (taskId < 0) {
+            starResultListener(
+                IllegalArgumentException("Failed to add torrent task: $sourceInfo")
+            )
+            return
+        }
+        torrentService.attachSession(taskId, this)
+        urlSeeds.forEach { torrentService.addUrlSeed(taskId, it) }
+        httpSeeds.forEach { torrentService.addHttpSeed(taskId, it) }
+        starResultListener(null)
+    }
+
+    /**
+     * Adds an HTTP mirror of the payload (BEP 19 web seed). Seeds added
+     * before [start] are attached once the task exists.
+     */
+    fun addUrlSeed(url: String) {
+        if (urlSeeds.add(url) && taskId >= 0) {
+            torrentService.addUrlSeed(taskId, url)
+        }
+    }
+
+    /** Adds a BEP 17 http seed, see [addUrlSeed] */
+    fun addHttpSeed(url: String) {
+        if (httpSeeds.add(url) && taskId >= 0) {
+            torrentService.addHttpSeed(taskId, url)
         }
     }
 
@@ -89,10 +125,12 @@ class TorrentDownloadSession : IDownloadSession {
 
     override suspend fun stop() {
         torrentService.taskRemove(taskId)
+        torrentService.detachSession(taskId)
     }
 
     override suspend fun remove() {
         torrentService.taskRemove(taskId)
+        torrentService.detachSession(taskId)
     }
 
     override fun addDownloadListener(listener: IDownloadListener) {
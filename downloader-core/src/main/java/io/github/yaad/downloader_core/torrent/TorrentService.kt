@@ -86,14 +86,25 @@ class TorrentService {
 
     @Keep
     fun onTaskUpdate(id: Long, st: TorrentDownloadStatus) {
-        val session = sessionMap[id]?.get()
+        val session = synchronized(sessionMap) { sessionMap[id]?.get() }
         session?.onStatusUpdate(st)
     }
 
+    /** Routes status updates of task [id] to [session] */
+    fun attachSession(id: Long, session: TorrentDownloadSession) {
+        synchronized(sessionMap) { sessionMap[id] = WeakReference(session) }
+    }
+
+    fun detachSession(id: Long) {
+        synchronized(sessionMap) { sessionMap.remove(id) }
+    }
+
     external fun initService()
 
     external fun addTaskByLink(link: String, save: String): Long
 
+    external fun addTaskByFile(torrentFile: String, save: String): Long
+
     external fun getTaskStatus(id: Long): TorrentDownloadStatus
 
     external fun taskPause(id: Long)
@@ -102,5 +113,9 @@ class TorrentService {
 
     external fun taskRemove(id: Long)
 
+    external fun addUrlSeed(id: Long, url: String): Boolean
+
+    external fun addHttpSeed(id: Long, url: String): Boolean
+
     external fun torrentUpdate()
 }
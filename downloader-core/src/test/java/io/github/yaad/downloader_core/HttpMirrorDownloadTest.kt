@@ -0,0 +1,220 @@
+package io.github.yaad.downloader_core
+
+import com.sun.net.httpserver.HttpExchange
+import com.sun.net.httpserver.HttpServer
+import java.io.File
+import java.io.IOException
+import java.net.InetAddress
+import java.net.InetSocketAddress
+import java.util.concurrent.ExecutorService
+import java.util.concurrent.Executors
+import java.util.concurrent.atomic.AtomicBoolean
+import java.util.concurrent.atomic.AtomicInteger
+import java.util.concurrent.atomic.AtomicLong
+import kotlin.random.Random
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.runBlocking
+import kotlinx.coroutines.withTimeout
+import org.junit.After
+import org.junit.Assert.assertArrayEquals
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertNull
+import org.junit.Assert.assertTrue
+import org.junit.Rule
+import org.junit.Test
+import org.junit.rules.TemporaryFolder
+
+class HttpMirrorDownloadTest {
+    @get:Rule val tempFolder = TemporaryFolder()
+
+    private val payload = Random(42).nextBytes(16 * 1024 * 1024)
+    private val servers = mutableListOf<RangeServer>()
+
+    @After
+    fun tearDown() {
+        servers.forEach { it.stop() }
+    }
+
+    @Test
+    fun mirrorsTogetherBeatTheFastestSource() = runBlocking {
+        val slowRate = 1024 * 1024
+        val fastRate = 2 * 1024 * 1024
+        val slow = RangeServer(payload, slowRate).also { servers.add(it) }
+        val fast = RangeServer(payload, fastRate).also { servers.add(it) }
+        val target = tempFolder.newFile("payload.bin")
+
+        val startedAt = System.currentTimeMillis()
+        download(slow.url, listOf(fast.url), target)
+        val elapsed = System.currentTimeMillis() - startedAt
+
+        assertArrayEquals(payload, target.readBytes())
+        assertTrue(
+            "fast mirror served ${fast.servedBytes.get()} bytes, slow primary ${slow.servedBytes.get()}",
+            fast.servedBytes.get() > slow.servedBytes.get()
+        )
+        // The fast server alone can't deliver the payload in less than this
+        val fastOnlyMillis = payload.size * 1000L / fastRate
+        assertTrue(
+            "took $elapsed ms, the fast mirror alone needs at least $fastOnlyMillis ms",
+            elapsed < fastOnlyMillis
+        )
+    }
+
+    @Test
+    fun droppedConnectionWithoutRangesRestartsFromTheBeginning() = runBlocking {
+        // Request 1 is the size probe, request 2 the download, which is cut off halfway
+        val server =
+            RangeServer(
+                    payload,
+                    16 * 1024 * 1024,
+                    supportsRanges = false,
+                    dropRequest = 2
+                )
+                .also { servers.add(it) }
+        val target = tempFolder.newFile("payload.bin")
+
+        download(server.url, emptyList(), target)
+
+        assertArrayEquals(payload, target.readBytes())
+        assertTrue(server.requests.get() >= 3)
+    }
+
+    private suspend fun download(url: String, mirrors: List<String>, target: File) {
+        val session =
+            HttpDownloadSession(
+                url,
+                target.path,
+                emptyMap(),
+                4,
+                mirrors,
+                RandomAccessFileIo()
+            )
+        val finished = AtomicBoolean(false)
+        var startError: Exception? = null
+        session.start({ startError = it }, { finished.set(true) })
+        assertNull(startError)
+
+        withTimeout(60_000) {
+            while (
+                !finished.get() && session.getStatus().state != DownloadState.ERROR
+            ) {
+                delay(50)
+            }
+        }
+
+        val status = session.getStatus()
+        assertEquals(status.errorMessage, DownloadState.COMPLETED, status.state)
+    }
+
+    /*
+     * Serves payload at bytesPerSecond shared by all connections, like a
+     * server with limited bandwidth. Without range support Range headers
+     * are ignored. The body of request number dropRequest is cut off halfway.
+     */
+    private class RangeServer(
+        private val payload: ByteArray,
+        private val bytesPerSecond: Int,
+        private val supportsRanges: Boolean = true,
+        private val dropRequest: Int = -1
+    ) {
+        // Body bytes sent in answer to range requests
+        val servedBytes = AtomicLong()
+        val requests = AtomicInteger()
+
+        // When the bandwidth is free again, shared by every connection
+        private val pacingLock = Any()
+        private var nextFreeNanos = 0L
+
+        private val executor: ExecutorService = Executors.newCachedThreadPool()
+        private val server =
+            HttpServer.create(
+                InetSocketAddress(InetAddress.getLoopbackAddress(), 0),
+                0
+            )
+
+        val url: String
+            get() = "http://127.0.0.1:${server.address.port}/payload.bin"
+
+        init {
+            server.executor = executor
+            server.createContext("/payload.bin") { serve(it) }
+            server.start()
+        }
+
+        private fun serve(exchange: HttpExchange) {
+            try {
+                val request = requests.incrementAndGet()
+                val range =
+                    exchange.requestHeaders
+                        .getFirst("Range")
+                        ?.takeIf { supportsRanges }
+                        ?.let { RANGE.matchEntire(it.trim()) }
+                val start = range?.groupValues?.get(1)?.toLong() ?: 0L
+                val end =
+                    range
+                        ?.groupValues
+                        ?.get(2)
+                        ?.toLongOrNull()
+                        ?.coerceAtMost(payload.size - 1L) ?: (payload.size - 1L)
+                if (supportsRanges) {
+                    exchange.responseHeaders.add("Accept-Ranges", "bytes")
+                }
+                if (range != null) {
+                    exchange.responseHeaders.add(
+                        "Content-Range",
+                        "bytes $start-$end/${payload.size}"
+                    )
+                    exchange.sendResponseHeaders(206, end - start + 1)
+                } else {
+                    exchange.sendResponseHeaders(200, payload.size.toLong())
+                }
+
+                val out = exchange.responseBody
+                var offset = start
+                val last = if (request == dropRequest) (start + end) / 2 else end
+                while (offset <= last) {
+                    val length = minOf(CHUNK_SIZE.toLong(), last - offset + 1).toInt()
+                    pace(length)
+                    out.write(payload, offset.toInt(), length)
+                    out.flush()
+                    if (range != null) servedBytes.addAndGet(length.toLong())
+                    offset += length
+                }
+            } catch (e: IOException) {
+                // The client hung up, e.g. after the rest of its part was taken over
+            } catch (e: InterruptedException) {
+                // Server shutting down
+            } finally {
+                try {
+                    exchange.close()
+                } catch (e: IOException) {
+                    // Closing a body that was cut off short also drops the connection
+                }
+            }
+        }
+
+        private fun pace(bytes: Int) {
+            val waitNanos =
+                synchronized(pacingLock) {
+                    val now = System.nanoTime()
+                    if (nextFreeNanos < now) nextFreeNanos = now
+                    val wait = nextFreeNanos - now
+                    nextFreeNanos += bytes * 1_000_000_000L / bytesPerSecond
+                    wait
+                }
+            if (waitNanos > 0) {
+                Thread.sleep(waitNanos / 1_000_000, (waitNanos % 1_000_000).toInt())
+            }
+        }
+
+        fun stop() {
+            server.stop(0)
+            executor.shutdownNow()
+        }
+
+        companion object {
+            private const val CHUNK_SIZE = 16 * 1024
+            private val RANGE = Regex("""bytes=(\d+)-(\d*)""")
+        }
+    }
+}